@@ -0,0 +1,70 @@
+#ifndef AABB_H_
+#define AABB_H_
+#include "Ray.h"
+#include <algorithm>
+#include <limits>
+
+struct AABB {
+  AABB()
+      : min(std::numeric_limits<float>::infinity(),
+            std::numeric_limits<float>::infinity(),
+            std::numeric_limits<float>::infinity()),
+        max(-std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity(),
+            -std::numeric_limits<float>::infinity()) {}
+  AABB(const Point3f &min, const Point3f &max) : min(min), max(max) {}
+
+  bool hit(const Ray &r, float tMin, float tMax) const {
+    for (int a = 0; a < 3; ++a) {
+      float invD = 1.0f / r.dir[a];
+      float t0 = (min[a] - r.origin[a]) * invD;
+      float t1 = (max[a] - r.origin[a]) * invD;
+      if (invD < 0.0f) std::swap(t0, t1);
+      tMin = t0 > tMin ? t0 : tMin;
+      tMax = t1 < tMax ? t1 : tMax;
+      if (tMax < tMin) return false;
+    }
+    return true;
+  }
+
+  void expand(const Point3f &p) {
+    for (int a = 0; a < 3; ++a) {
+      min[a] = std::min(min[a], p[a]);
+      max[a] = std::max(max[a], p[a]);
+    }
+  }
+
+  void expand(const AABB &o) {
+    for (int a = 0; a < 3; ++a) {
+      min[a] = std::min(min[a], o.min[a]);
+      max[a] = std::max(max[a], o.max[a]);
+    }
+  }
+
+  bool empty() const { return min.x > max.x; }
+
+  Point3f centroid() const { return (min + max) * 0.5f; }
+
+  float area() const {
+    if (empty()) return 0;
+    Vec3f d = max - min;
+    return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+  }
+
+  int maxExtent() const {
+    Vec3f d = max - min;
+    if (d.x > d.y && d.x > d.z) return 0;
+    return d.y > d.z ? 1 : 2;
+  }
+
+  Point3f min;
+  Point3f max;
+};
+
+inline AABB surroundingBox(const AABB &a, const AABB &b) {
+  AABB box = a;
+  box.expand(b);
+  return box;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef BVH_H_
+#define BVH_H_
+#include "Hit.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+// binary BVH over arbitrary hitables, split by binned SAH
+struct BVHNode : public Hitable {
+  BVHNode() = default;
+  BVHNode(const HitList &list) : BVHNode(list.objects) {}
+  BVHNode(std::vector<std::shared_ptr<Hitable> > objects)
+      : BVHNode(objects, 0, objects.size()) {}
+  BVHNode(std::vector<std::shared_ptr<Hitable> > &objects, size_t start,
+          size_t end) {
+    build(objects, start, end);
+  }
+
+  bool intersect(const Ray &r, float tMin, float tMax,
+                 Intersection &isect) const override {
+    if (!box.hit(r, tMin, tMax)) return false;
+    // visit the near child first so the far one is culled by a smaller tMax
+    const auto &first = r.dir[axis] < 0 ? right : left;
+    const auto &second = r.dir[axis] < 0 ? left : right;
+    bool hitFirst = first->intersect(r, tMin, tMax, isect);
+    if (second == first) return hitFirst;
+    bool hitSecond =
+        second->intersect(r, tMin, hitFirst ? isect.t : tMax, isect);
+    return hitFirst || hitSecond;
+  }
+
+  void surface(const Ray &, const Intersection &, HitRecord &) const override {
+    assert(false && "hits resolve to the leaf that reported them");
+  }
+
+  bool boundingBox(AABB &outputBox) const override {
+    outputBox = box;
+    return true;
+  }
+
+  std::shared_ptr<Hitable> left;
+  std::shared_ptr<Hitable> right;
+  AABB box;
+  int axis = 0;
+
+ private:
+  static const int BUCKETS = 12;
+
+  static AABB boxOf(const std::shared_ptr<Hitable> &object) {
+    AABB b;
+    if (!object->boundingBox(b)) {
+      std::cerr << "[ERROR] No bounding box in BVHNode constructor"
+                << std::endl;
+      exit(-1);
+    }
+    return b;
+  }
+
+  void build(std::vector<std::shared_ptr<Hitable> > &objects, size_t start,
+             size_t end) {
+    size_t n = end - start;
+    box = AABB();
+    AABB centroidBox;
+    for (size_t i = start; i < end; ++i) {
+      AABB b = boxOf(objects[i]);
+      box.expand(b);
+      centroidBox.expand(b.centroid());
+    }
+    axis = centroidBox.maxExtent();
+
+    if (n == 1) {
+      left = right = objects[start];
+      return;
+    }
+    if (n == 2) {
+      left = objects[start];
+      right = objects[start + 1];
+      if (boxOf(left).centroid()[axis] > boxOf(right).centroid()[axis])
+        std::swap(left, right);
+      return;
+    }
+
+    size_t mid = start + n / 2;
+    float lo = centroidBox.min[axis], hi = centroidBox.max[axis];
+    auto centroidOf = [&](const std::shared_ptr<Hitable> &o) {
+      return boxOf(o).centroid()[axis];
+    };
+    if (hi > lo) {
+      auto bucketOf = [&](const std::shared_ptr<Hitable> &o) {
+        int b = static_cast<int>(BUCKETS * (centroidOf(o) - lo) / (hi - lo));
+        return std::min(b, BUCKETS - 1);
+      };
+      int count[BUCKETS] = {};
+      AABB bounds[BUCKETS];
+      for (size_t i = start; i < end; ++i) {
+        int b = bucketOf(objects[i]);
+        ++count[b];
+        bounds[b].expand(boxOf(objects[i]));
+      }
+      // cost of splitting after bucket i, relative to the parent's area
+      AABB rightBounds[BUCKETS];
+      int rightCount[BUCKETS] = {};
+      for (int i = BUCKETS - 1; i > 0; --i) {
+        rightBounds[i - 1] = i < BUCKETS - 1 ? rightBounds[i] : AABB();
+        rightBounds[i - 1].expand(bounds[i]);
+        rightCount[i - 1] = (i < BUCKETS - 1 ? rightCount[i] : 0) + count[i];
+      }
+      float bestCost = std::numeric_limits<float>::infinity();
+      int bestSplit = 0;
+      AABB leftBounds;
+      int leftCount = 0;
+      for (int i = 0; i < BUCKETS - 1; ++i) {
+        leftBounds.expand(bounds[i]);
+        leftCount += count[i];
+        float cost = leftCount * leftBounds.area() +
+                     rightCount[i] * rightBounds[i].area();
+        if (leftCount && rightCount[i] && cost < bestCost) {
+          bestCost = cost;
+          bestSplit = i;
+        }
+      }
+      auto it = std::partition(
+          objects.begin() + start, objects.begin() + end,
+          [&](const std::shared_ptr<Hitable> &o) {
+            return bucketOf(o) <= bestSplit;
+          });
+      mid = it - objects.begin();
+    }
+    if (mid == start || mid == end) {
+      // all centroids coincide, fall back to a median split
+      mid = start + n / 2;
+      std::nth_element(objects.begin() + start, objects.begin() + mid,
+                       objects.begin() + end,
+                       [&](const std::shared_ptr<Hitable> &a,
+                           const std::shared_ptr<Hitable> &b) {
+                         return centroidOf(a) < centroidOf(b);
+                       });
+    }
+    left = std::make_shared<BVHNode>(objects, start, mid);
+    right = std::make_shared<BVHNode>(objects, mid, end);
+  }
+};
+
+#endif
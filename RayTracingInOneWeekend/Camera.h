@@ -2,6 +2,7 @@
 #define CAMERA_H_
 #include "Math.h"
 #include "Ray.h"
+#include "Sampler.h"
 
 class Camera {
  public:
@@ -13,9 +14,9 @@ class Camera {
     float viewportWidth = aspectRatio * viewportHeight;
     float focalLength = 1.0f;
 
-    Vec3f w = normalize(lookfrom - lookat);
-    Vec3f u = normalize(cross(up, w));
-    Vec3f v = cross(w, u);
+    w = normalize(lookfrom - lookat);
+    u = normalize(cross(up, w));
+    v = cross(w, u);
 
     origin = lookfrom;
     horizontal = focusDis * viewportWidth * u;
@@ -24,8 +25,9 @@ class Camera {
     lensRadius = aperture / 2;
   }
 
-  Ray getRay(float s, float t) const {
-    Vec3f r = lensRadius * randomInUnitDisk();
+  // always takes the sampler's lens dimension, even for a pinhole
+  Ray getRay(float s, float t, Sampler &sampler) const {
+    Vec3f r = lensRadius * sampleUnitDisk(sampler.get2D());
     Vec3f offset = u * r.x + v * r.y;
     return Ray(origin + offset,
                lowerLeft + s * horizontal + t * vertical - origin - offset);
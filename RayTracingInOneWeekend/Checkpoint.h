@@ -0,0 +1,173 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+#include "Film.h"
+#include "Renderer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// render checkpoint: a header with every setting that decides what a pixel
+// sample computes, then the film's per-pixel sample counts and sums (and
+// the luminance statistics, for adaptive renders only). There is no
+// separate RNG state: sample k of a pixel always draws from
+// Sampler(kind, pixel, k, spp, seed), so the counts are the state, and a
+// resumed render adds exactly the samples an uninterrupted one would have.
+// Host byte order; bump CHECKPOINT_VERSION when the layout changes
+const uint32_t CHECKPOINT_VERSION = 2;
+const char CHECKPOINT_MAGIC[8] = {'R', 'T', 'C', 'K', 'P', 'T', 0, 0};
+
+struct CheckpointHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t width, height;
+  int32_t maxDepth, rouletteDepth;
+  float rouletteMaxSurvival;
+  uint64_t seed;
+  uint32_t adaptive;
+  int32_t minSpp;
+  float adaptiveThreshold;
+  uint32_t sampler;
+  // stratified renders only, their strata depend on it
+  int32_t strataSpp;
+  uint32_t pad;
+  // identifies the scene, which the settings don't cover
+  uint64_t scene;
+};
+
+// FNV-1a of whatever names the scene
+inline uint64_t checkpointSceneKey(const std::string &name) {
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : name) h = (h ^ c) * 1099511628211ull;
+  return h;
+}
+
+// folds up to maxBytes of the file at path, then its size, into key, so
+// that editing or rewriting a scene source changes the key; false if the
+// file can't be read
+inline bool hashSceneSource(const std::string &path, uint64_t &key,
+                            size_t maxBytes = SIZE_MAX) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) return false;
+  char buffer[1 << 16];
+  uint64_t size = 0;
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    size_t hashed = size < maxBytes ? std::min<uint64_t>(n, maxBytes - size)
+                                    : 0;
+    for (size_t i = 0; i < hashed; ++i)
+      key = (key ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+    size += n;
+  }
+  fclose(file);
+  for (int i = 0; i < 8; ++i)
+    key = (key ^ ((size >> (8 * i)) & 0xff)) * 1099511628211ull;
+  return true;
+}
+
+inline CheckpointHeader checkpointHeader(const RenderSettings &s,
+                                         uint64_t scene) {
+  CheckpointHeader h = {};
+  memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+  h.version = CHECKPOINT_VERSION;
+  h.width = s.width;
+  h.height = s.height;
+  h.maxDepth = s.maxDepth;
+  h.rouletteDepth = s.rouletteDepth;
+  h.rouletteMaxSurvival = s.rouletteMaxSurvival;
+  h.seed = s.seed;
+  h.adaptive = s.adaptive;
+  h.sampler = static_cast<uint32_t>(s.sampler);
+  if (s.sampler == SamplerKind::Stratified) h.strataSpp = s.spp;
+  // these only matter to adaptive renders
+  if (s.adaptive) {
+    h.minSpp = s.minSpp;
+    h.adaptiveThreshold = s.adaptiveThreshold;
+  }
+  h.scene = scene;
+  return h;
+}
+
+// whether the temporary file saveCheckpoint writes can be created, so a
+// bad path shows up before the render rather than when it's first saved
+inline bool checkpointWritable(const std::string &path) {
+  std::string tmp = path + ".tmp";
+  FILE *file = fopen(tmp.c_str(), "wb");
+  if (!file) {
+    std::cerr << "[ERROR] Failed to open " << tmp << std::endl;
+    return false;
+  }
+  fclose(file);
+  remove(tmp.c_str());
+  return true;
+}
+
+// written to path.tmp first and renamed over path, so a crash while saving
+// leaves the previous checkpoint intact
+inline bool saveCheckpoint(const std::string &path, const RenderSettings &s,
+                           uint64_t scene, const Film &film) {
+  CheckpointHeader header = checkpointHeader(s, scene);
+  std::string tmp = path + ".tmp";
+  FILE *file = fopen(tmp.c_str(), "wb");
+  if (!file) {
+    std::cerr << "[ERROR] Failed to open " << tmp << std::endl;
+    return false;
+  }
+  size_t n = film.count.size();
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(film.count.data(), sizeof(int), n, file) == n &&
+            fwrite(film.sum.data(), sizeof(Color3f), n, file) == n;
+  if (ok && s.adaptive) {
+    ok = fwrite(film.lumMean.data(), sizeof(float), n, file) == n &&
+         fwrite(film.lumM2.data(), sizeof(float), n, file) == n;
+  }
+  ok = fclose(file) == 0 && ok;
+  if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+  if (!ok) std::cerr << "[ERROR] Failed to write " << path << std::endl;
+  return ok;
+}
+
+// fills a fresh film of the image's size; fails unless the checkpoint was
+// taken with the same scene and settings (spp aside, which may grow unless
+// the sampler is stratified)
+inline bool loadCheckpoint(const std::string &path, const RenderSettings &s,
+                           uint64_t scene, Film &film) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    std::cerr << "[ERROR] Failed to open " << path << std::endl;
+    return false;
+  }
+  CheckpointHeader header, expected = checkpointHeader(s, scene);
+  bool ok = fread(&header, sizeof(header), 1, file) == 1;
+  if (!ok || memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) ||
+      header.version != CHECKPOINT_VERSION) {
+    std::cerr << "[ERROR] " << path << " is not a version "
+              << CHECKPOINT_VERSION << " checkpoint" << std::endl;
+    fclose(file);
+    return false;
+  }
+  if (memcmp(&header, &expected, sizeof(header))) {
+    std::cerr << "[ERROR] " << path
+              << " was rendered with another scene or settings" << std::endl;
+    fclose(file);
+    return false;
+  }
+  size_t n = film.count.size();
+  ok = fread(film.count.data(), sizeof(int), n, file) == n &&
+       fread(film.sum.data(), sizeof(Color3f), n, file) == n;
+  if (ok && s.adaptive) {
+    ok = fread(film.lumMean.data(), sizeof(float), n, file) == n &&
+         fread(film.lumM2.data(), sizeof(float), n, file) == n;
+  }
+  fclose(file);
+  if (!ok) {
+    std::cerr << "[ERROR] " << path << " is truncated" << std::endl;
+    return false;
+  }
+  // without adaptive sampling the luminance statistics are never read
+  return true;
+}
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef DISTRIBUTED_H_
+#define DISTRIBUTED_H_
+#include "Renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// multi-process rendering on one POSIX machine: the coordinator forks
+// worker processes once the world is built (so they share it copy-on-write)
+// and hands out bands of bandHeight rows over pipes, one at a time to
+// whichever worker is idle. A worker renders its band with a Renderer and
+// sends back the band's film state, which the coordinator copies into its
+// own film. Every pixel is rendered by exactly one process with the usual
+// per-pixel sample seeds, so the image matches a single-process render
+// whatever the number of workers or the order bands finish in
+#ifndef _WIN32
+class DistributedRenderer {
+ public:
+  DistributedRenderer(const RenderSettings &settings, const Camera &cam,
+                      const Hitable &world, const MaterialTable &materials,
+                      int workers, int bandHeight = 32)
+      : settings(settings),
+        cam(cam),
+        world(world),
+        materials(materials),
+        film(settings.width, settings.height),
+        workers(std::max(1, workers)),
+        bandHeight(std::max(1, bandHeight)) {}
+
+  // fatal errors (a worker dying, a broken pipe) end the process
+  RenderStats render() {
+    auto start = std::chrono::high_resolution_clock::now();
+    RenderStats stats;
+    // a dead worker shows up as end of file, not as a signal
+    signal(SIGPIPE, SIG_IGN);
+    std::vector<Worker> pool;
+    for (int w = 0; w < workers; ++w) pool.push_back(spawn(pool));
+    int nextRow = 0, busy = 0;
+    auto assign = [&](Worker &w) {
+      Band band{nextRow, std::min(bandHeight, settings.height - nextRow)};
+      if (band.rows <= 0) band = Band{0, 0};  // quit
+      writeAll(w.toWorker, &band, sizeof(band));
+      nextRow += band.rows;
+      w.busy = band.rows > 0;
+      busy += w.busy;
+    };
+    for (auto &w : pool) assign(w);
+
+    std::vector<pollfd> fds(pool.size());
+    while (busy > 0) {
+      for (size_t i = 0; i < pool.size(); ++i)
+        fds[i] = pollfd{pool[i].busy ? pool[i].fromWorker : -1, POLLIN, 0};
+      if (poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno == EINTR) continue;
+        fail("poll failed");
+      }
+      for (size_t i = 0; i < pool.size(); ++i) {
+        if (!pool[i].busy || !fds[i].revents) continue;
+        receive(pool[i].fromWorker, stats);
+        --busy;
+        assign(pool[i]);
+      }
+    }
+    for (auto &w : pool) {
+      close(w.toWorker);
+      close(w.fromWorker);
+      int status;
+      waitpid(w.pid, &status, 0);
+    }
+    auto now = std::chrono::high_resolution_clock::now();
+    stats.seconds = std::chrono::duration<double>(now - start).count();
+    return stats;
+  }
+
+  const RenderSettings settings;
+  const Camera &cam;
+  const Hitable &world;
+  const MaterialTable &materials;
+  Film film;
+  const int workers;
+  const int bandHeight;
+
+ private:
+  struct Band {
+    int32_t y0, rows;  // rows 0 -> exit
+  };
+
+  struct BandResult {
+    Band band;
+    int64_t samples, rays;
+  };
+
+  struct Worker {
+    pid_t pid;
+    int toWorker, fromWorker;
+    bool busy;
+  };
+
+  [[noreturn]] static void fail(const char *message) {
+    std::cerr << "[ERROR] Distributed render: " << message << std::endl;
+    exit(-1);
+  }
+
+  static void writeAll(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+      ssize_t n = write(fd, p, size);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) fail("write to pipe failed");
+      p += n;
+      size -= n;
+    }
+  }
+
+  // false on a clean end of file before anything was read
+  static bool readAll(int fd, void *data, size_t size) {
+    char *p = static_cast<char *>(data);
+    size_t left = size;
+    while (left > 0) {
+      ssize_t n = read(fd, p, left);
+      if (n < 0 && errno == EINTR) continue;
+      if (n == 0 && left == size) return false;
+      if (n <= 0) fail("read from pipe failed");
+      p += n;
+      left -= n;
+    }
+    return true;
+  }
+
+  // the per-pixel film arrays of a band, in the order they go over a pipe
+  template <typename F>
+  static void forEachArray(Film &f, size_t offset, size_t n, F fn) {
+    fn(&f.count[offset], n * sizeof(int));
+    fn(&f.sum[offset], n * sizeof(Color3f));
+    fn(&f.lumMean[offset], n * sizeof(float));
+    fn(&f.lumM2[offset], n * sizeof(float));
+  }
+
+  Worker spawn(const std::vector<Worker> &others) {
+    int down[2], up[2];
+    if (pipe(down) != 0 || pipe(up) != 0) fail("pipe failed");
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid < 0) fail("fork failed");
+    if (pid == 0) {
+      // only this worker's ends stay open
+      for (const auto &w : others) {
+        close(w.toWorker);
+        close(w.fromWorker);
+      }
+      close(down[1]);
+      close(up[0]);
+      work(down[0], up[1]);
+      _exit(0);
+    }
+    close(down[0]);
+    close(up[1]);
+    return Worker{pid, down[1], up[0], false};
+  }
+
+  void work(int in, int out) {
+    Band band;
+    while (readAll(in, &band, sizeof(band)) && band.rows > 0) {
+      RenderSettings s = settings;
+      s.progressive = false;
+      s.timeBudget = 0;
+      s.bandY0 = band.y0;
+      s.bandHeight = band.rows;
+      Renderer renderer(s, cam, world, materials);
+      RenderStats stats = renderer.render();
+      BandResult result{band, stats.samples, stats.rays};
+      writeAll(out, &result, sizeof(result));
+      auto send = [&](const void *p, size_t size) { writeAll(out, p, size); };
+      forEachArray(renderer.film, 0, renderer.film.count.size(), send);
+    }
+  }
+
+  void receive(int fd, RenderStats &stats) {
+    BandResult result;
+    if (!readAll(fd, &result, sizeof(result))) fail("a worker died");
+    const Band &band = result.band;
+    if (band.y0 < 0 || band.rows <= 0 || band.y0 + band.rows > film.height)
+      fail("bad band from a worker");
+    size_t offset = static_cast<size_t>(band.y0) * film.width;
+    size_t n = static_cast<size_t>(band.rows) * film.width;
+    forEachArray(film, offset, n, [&](void *p, size_t size) {
+      if (!readAll(fd, p, size)) fail("a worker died");
+    });
+    stats.samples += result.samples;
+    stats.rays += result.rays;
+  }
+};
+#else
+// no fork on Windows
+class DistributedRenderer {
+ public:
+  DistributedRenderer(const RenderSettings &settings, const Camera &,
+                      const Hitable &, const MaterialTable &, int, int = 32)
+      : film(settings.width, settings.height) {}
+
+  RenderStats render() {
+    std::cerr << "[ERROR] Distributed rendering needs a POSIX system"
+              << std::endl;
+    exit(-1);
+  }
+
+  Film film;
+};
+#endif
+
+#endif
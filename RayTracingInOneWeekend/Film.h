@@ -0,0 +1,88 @@
+#ifndef FILM_H_
+#define FILM_H_
+#include "Math.h"
+#include <limits>
+#include <vector>
+
+// linear radiance accumulated over passes, plus per-pixel sample counts and
+// running luminance variance (Welford) for adaptive sampling
+struct Film {
+  Film(int width, int height)
+      : width(width),
+        height(height),
+        sum(width * height),
+        count(width * height),
+        lumMean(width * height),
+        lumM2(width * height) {}
+
+  void add(int x, int y, const Color3f &c) {
+    int i = y * width + x;
+    sum[i] += c;
+    float l = luminance(c);
+    int n = ++count[i];
+    float d = l - lumMean[i];
+    lumMean[i] += d / n;
+    lumM2[i] += d * (l - lumMean[i]);
+  }
+
+  int samples(int x, int y) const { return count[y * width + x]; }
+
+  Color3f mean(int x, int y) const {
+    int i = y * width + x;
+    if (count[i] == 0) return Color3f(0, 0, 0);
+    return sum[i] / static_cast<float>(count[i]);
+  }
+
+  // linear mean of row y as 3 floats per pixel
+  void meanRow(int y, float *rgb) const {
+    for (int x = 0; x < width; ++x) {
+      Color3f c = mean(x, y);
+      rgb[x * 3 + 0] = c.r();
+      rgb[x * 3 + 1] = c.g();
+      rgb[x * 3 + 2] = c.b();
+    }
+  }
+
+  float variance(int x, int y) const {
+    int i = y * width + x;
+    if (count[i] < 2) return std::numeric_limits<float>::infinity();
+    return lumM2[i] / (count[i] - 1);
+  }
+
+  // true once the 95% confidence interval of the pixel's mean luminance is
+  // within threshold of the mean (dark pixels are judged against 0.05)
+  bool converged(int x, int y, int minSamples, float threshold) const {
+    int i = y * width + x;
+    if (count[i] < std::max(minSamples, 2)) return false;
+    float halfWidth = 1.96f * std::sqrt(lumM2[i] / (count[i] - 1) / count[i]);
+    return halfWidth <= threshold * std::max(lumMean[i], 0.05f);
+  }
+
+  long long totalSamples() const {
+    long long total = 0;
+    for (int n : count) total += n;
+    return total;
+  }
+
+  int maxSamples() const {
+    int m = 0;
+    for (int n : count) m = std::max(m, n);
+    return m;
+  }
+
+  void clear() {
+    std::fill(sum.begin(), sum.end(), Color3f(0, 0, 0));
+    std::fill(count.begin(), count.end(), 0);
+    std::fill(lumMean.begin(), lumMean.end(), 0.0f);
+    std::fill(lumM2.begin(), lumM2.end(), 0.0f);
+  }
+
+  int width;
+  int height;
+  std::vector<Color3f> sum;
+  std::vector<int> count;
+  std::vector<float> lumMean;
+  std::vector<float> lumM2;
+};
+
+#endif
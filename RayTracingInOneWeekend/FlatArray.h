@@ -0,0 +1,92 @@
+#ifndef FLAT_ARRAY_H_
+#define FLAT_ARRAY_H_
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// contiguous array that either owns its elements or views memory owned by
+// someone else (e.g. a mapped scene cache, kept alive through owner).
+// Reads never copy; a view is copied into owned storage before the first
+// write
+template <typename T>
+class FlatArray {
+ public:
+  FlatArray() = default;
+  FlatArray(std::vector<T> elements) : owned(std::move(elements)) { sync(); }
+  FlatArray(const FlatArray &o) { *this = o; }
+  FlatArray(FlatArray &&o) { *this = std::move(o); }
+
+  FlatArray &operator=(const FlatArray &o) {
+    owned = o.owned;
+    owner = o.owner;
+    if (owner) {
+      ptr = o.ptr;
+      count = o.count;
+    } else {
+      sync();
+    }
+    return *this;
+  }
+
+  FlatArray &operator=(FlatArray &&o) {
+    owned = std::move(o.owned);
+    owner = std::move(o.owner);
+    if (owner) {
+      ptr = o.ptr;
+      count = o.count;
+    } else {
+      sync();
+    }
+    o.owned.clear();
+    o.owner.reset();
+    o.sync();
+    return *this;
+  }
+
+  static FlatArray view(const T *elements, size_t n,
+                        std::shared_ptr<const void> owner) {
+    FlatArray a;
+    a.ptr = elements;
+    a.count = n;
+    a.owner = std::move(owner);
+    return a;
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const T *data() const { return ptr; }
+  const T *begin() const { return ptr; }
+  const T *end() const { return ptr + count; }
+  const T &operator[](size_t i) const { return ptr[i]; }
+
+  T &operator[](size_t i) {
+    makeOwned();
+    return owned[i];
+  }
+
+  void resize(size_t n) {
+    makeOwned();
+    owned.resize(n);
+    sync();
+  }
+
+ private:
+  void makeOwned() {
+    if (!owner) return;
+    owned.assign(ptr, ptr + count);
+    owner.reset();
+    sync();
+  }
+
+  void sync() {
+    ptr = owned.data();
+    count = owned.size();
+  }
+
+  std::vector<T> owned;
+  std::shared_ptr<const void> owner;  // set for views
+  const T *ptr = nullptr;
+  size_t count = 0;
+};
+
+#endif
@@ -1,15 +1,18 @@
 #ifndef HIT_H_
 #define HIT_H_
 #include "Ray.h"
+#include "AABB.h"
+#include "Stats.h"
+#include <cassert>
+#include <cstdint>
 #include <vector>
 #include <memory>
 
-struct Material;
-
 struct HitRecord {
   Point3f p;
   Vec3f normal;
-  std::shared_ptr<Material> material;
+  // index into the scene's material table
+  uint32_t materialId;
   float t;
   bool frontFace;
 
@@ -19,9 +22,33 @@ struct HitRecord {
   }
 };
 
+struct Hitable;
+
+// what the closest-hit query returns: just enough to evaluate the surface
+// later, once, for the hit that survives
+struct Intersection {
+  float t;
+  uint32_t primId;          // primitive within object
+  const Hitable *object;    // the leaf that can resolve the surface
+  const Hitable *instance;  // transform to go through first, or null
+};
+
 struct Hitable {
-  virtual bool hit(const Ray &r, float tMin, float tMax,
-                   HitRecord &record) const = 0;
+  // closest hit in (tMin, tMax); isect is only written on success
+  virtual bool intersect(const Ray &r, float tMin, float tMax,
+                         Intersection &isect) const = 0;
+  // point, normal and material of a hit reported by this object;
+  // containers never report hits themselves and assert
+  virtual void surface(const Ray &r, const Intersection &isect,
+                       HitRecord &rec) const = 0;
+  virtual bool boundingBox(AABB &box) const = 0;
+
+  bool hit(const Ray &r, float tMin, float tMax, HitRecord &rec) const {
+    Intersection isect;
+    if (!intersect(r, tMin, tMax, isect)) return false;
+    (isect.instance ? isect.instance : isect.object)->surface(r, isect, rec);
+    return true;
+  }
 };
 
 struct HitList : public Hitable {
@@ -34,20 +61,34 @@ struct HitList : public Hitable {
 
   std::vector<std::shared_ptr<Hitable> > objects;
 
-  bool hit(const Ray &r, float tMin, float tMax,
-           HitRecord &rec) const override {
-    HitRecord tmpRec;
+  bool intersect(const Ray &r, float tMin, float tMax,
+                 Intersection &isect) const override {
     bool hitAny = false;
     auto closest = tMax;
+    RT_COUNT(listTests += objects.size());
     for (const auto &object : objects) {
-      if (object->hit(r, tMin, closest, tmpRec)) {
+      if (object->intersect(r, tMin, closest, isect)) {
         hitAny = true;
-        closest = tmpRec.t;
-        rec = tmpRec;
+        closest = isect.t;
       }
     }
     return hitAny;
   }
+
+  void surface(const Ray &, const Intersection &, HitRecord &) const override {
+    assert(false && "hits resolve to the leaf that reported them");
+  }
+
+  bool boundingBox(AABB &box) const override {
+    if (objects.empty()) return false;
+    box = AABB();
+    AABB tmpBox;
+    for (const auto &object : objects) {
+      if (!object->boundingBox(tmpBox)) return false;
+      box.expand(tmpBox);
+    }
+    return true;
+  }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef IMAGE_IO_H_
+#define IMAGE_IO_H_
+#include "Film.h"
+#include "ToneMap.h"
+#include "stb_image_write.h"
+#include <algorithm>
+#include <vector>
+
+// height rows, bottom first, that row(j, rgb) fills with linear values,
+// tone mapped to an 8-bit png
+template <typename RowFn>
+inline bool writeRows(int width, int height, const char *path,
+                      const ToneMapSettings &toneMapping, RowFn row) {
+  size_t n = static_cast<size_t>(width) * 3;
+  std::vector<float> linear(n);
+  std::vector<unsigned char> data(n * height);
+  for (int j = 0; j < height; ++j) {
+    row(j, linear.data());
+    toneMap(linear.data(), n, toneMapping);
+    quantize(linear.data(), n, &data[n * j]);
+  }
+  stbi_flip_vertically_on_write(true);
+  return stbi_write_png(path, width, height, 3, data.data(), 0);
+}
+
+// mean of every pixel, by default clamped and gamma 2 corrected
+inline bool writeImage(const Film &film, const char *path,
+                       const ToneMapSettings &toneMapping = {}) {
+  return writeRows(film.width, film.height, path, toneMapping,
+                   [&](int j, float *rgb) { film.meanRow(j, rgb); });
+}
+
+// a linear buffer of 3 floats per pixel, bottom row first (as in a PFM)
+inline bool writeImage(const float *rgb, int width, int height,
+                       const char *path,
+                       const ToneMapSettings &toneMapping = {}) {
+  size_t n = static_cast<size_t>(width) * 3;
+  return writeRows(width, height, path, toneMapping, [&](int j, float *row) {
+    std::copy(rgb + n * j, rgb + n * (j + 1), row);
+  });
+}
+
+// value(i, j) / maxValue per pixel as a heat map, blue (none) to red
+template <typename ValueFn>
+inline bool writeHeat(int width, int height, float maxValue, const char *path,
+                      ValueFn value) {
+  std::vector<unsigned char> data(width * height * 4);
+  for (int j = 0; j < height; ++j) {
+    for (int i = 0; i < width; ++i) {
+      Color3f c = heatColor(value(i, j) / maxValue);
+      unsigned char *p = &data[(j * width + i) * 4];
+      p[0] = static_cast<int>(c.r() * 255.99);
+      p[1] = static_cast<int>(c.g() * 255.99);
+      p[2] = static_cast<int>(c.b() * 255.99);
+      p[3] = 255;
+    }
+  }
+  stbi_flip_vertically_on_write(true);
+  return stbi_write_png(path, width, height, 4, data.data(), 0);
+}
+
+// samples spent per pixel, relative to the most any pixel got
+inline bool writeHeatmap(const Film &film, const char *path) {
+  float maxSamples = std::max(film.maxSamples(), 1);
+  return writeHeat(film.width, film.height, maxSamples, path,
+                   [&](int i, int j) { return film.samples(i, j); });
+}
+
+// a per-pixel cost (Renderer::costs.seconds or .rays) relative to its 99th
+// percentile, so a few pixels that were preempted don't wash out the rest
+template <typename T>
+inline bool writeCostMap(const std::vector<T> &cost, int width, int height,
+                         const char *path) {
+  if (cost.empty()) return false;
+  std::vector<T> sorted = cost;
+  auto p99 = sorted.begin() + (sorted.size() - 1) * 99 / 100;
+  std::nth_element(sorted.begin(), p99, sorted.end());
+  float maxCost = *p99 > 0 ? static_cast<float>(*p99) : 1;
+  return writeHeat(width, height, maxCost, path, [&](int i, int j) {
+    return static_cast<float>(cost[j * width + i]);
+  });
+}
+
+#endif
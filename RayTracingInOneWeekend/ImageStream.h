@@ -0,0 +1,193 @@
+#ifndef IMAGE_STREAM_H_
+#define IMAGE_STREAM_H_
+#include "Film.h"
+#include "ToneMap.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+inline bool littleEndianHost() {
+  const uint16_t one = 1;
+  return *reinterpret_cast<const uint8_t *>(&one) == 1;
+}
+
+// writes an image a band of rows at a time straight to disk, so memory use
+// does not grow with the resolution. Binary PPM holds the tone mapped 8-bit
+// mean (as writeImage) top row first, PFM the linear float mean (in host
+// byte order, which the sign of its scale records) bottom row first; bands
+// have to arrive in that order
+class ImageStream {
+ public:
+  enum class Format { PPM, PFM };
+
+  // format from the extension of path
+  static bool formatOf(const std::string &path, Format &format) {
+    size_t dot = path.find_last_of('.');
+    std::string ext = dot == std::string::npos ? "" : path.substr(dot);
+    if (ext == ".ppm") {
+      format = Format::PPM;
+    } else if (ext == ".pfm") {
+      format = Format::PFM;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  ImageStream(const ImageStream &) = delete;
+  ImageStream &operator=(const ImageStream &) = delete;
+  ~ImageStream() {
+    if (file) fclose(file);
+  }
+
+  // nullptr on an unknown extension or when the file can't be created;
+  // toneMapping applies to PPM only
+  static std::unique_ptr<ImageStream> open(
+      const std::string &path, int width, int height,
+      const ToneMapSettings &toneMapping = {}) {
+    Format format;
+    if (!formatOf(path, format)) {
+      std::cerr << "[ERROR] " << path << " is neither .ppm nor .pfm"
+                << std::endl;
+      return nullptr;
+    }
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file) {
+      std::cerr << "[ERROR] Failed to open " << path << std::endl;
+      return nullptr;
+    }
+    if (format == Format::PPM)
+      fprintf(file, "P6\n%d %d\n255\n", width, height);
+    else
+      fprintf(file, "PF\n%d %d\n%s\n", width, height,
+              littleEndianHost() ? "-1.0" : "1.0");
+    return std::unique_ptr<ImageStream>(
+        new ImageStream(path, file, format, width, height, toneMapping));
+  }
+
+  bool bottomUp() const { return format == Format::PFM; }
+
+  int remaining() const { return height - rows; }
+
+  // first image row of the band of bandHeight rows the file expects next
+  int nextBand(int bandHeight) const {
+    return bottomUp() ? rows : height - rows - bandHeight;
+  }
+
+  // film rows are image rows [y0, y0 + film.height)
+  bool write(const Film &film, int y0) {
+    if (film.width != width || film.height > remaining() ||
+        y0 != nextBand(film.height)) {
+      std::cerr << "[ERROR] Out of order band for " << path << std::endl;
+      return false;
+    }
+    for (int k = 0; k < film.height; ++k) {
+      int j = bottomUp() ? k : film.height - 1 - k;
+      if (!writeRow(film, j)) {
+        std::cerr << "[ERROR] Failed to write " << path << std::endl;
+        return false;
+      }
+    }
+    rows += film.height;
+    return true;
+  }
+
+  // false if rows are missing or the data didn't make it to disk
+  bool close() {
+    // closed either way, the destructor won't see it again
+    bool closed = fclose(file) == 0;
+    file = nullptr;
+    bool ok = rows == height && closed;
+    if (!ok) std::cerr << "[ERROR] Failed to write " << path << std::endl;
+    return ok;
+  }
+
+ private:
+  ImageStream(const std::string &path, FILE *file, Format format, int width,
+              int height, const ToneMapSettings &toneMapping)
+      : path(path),
+        file(file),
+        format(format),
+        width(width),
+        height(height),
+        toneMapping(toneMapping) {}
+
+  bool writeRow(const Film &film, int j) {
+    floats.resize(width * 3);
+    film.meanRow(j, floats.data());
+    if (format == Format::PFM)
+      return fwrite(floats.data(), sizeof(float), floats.size(), file) ==
+             floats.size();
+    bytes.resize(floats.size());
+    toneMap(floats.data(), floats.size(), toneMapping);
+    quantize(floats.data(), floats.size(), bytes.data());
+    return fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+  }
+
+  std::string path;
+  FILE *file;
+  Format format;
+  int width, height;
+  ToneMapSettings toneMapping;
+  int rows = 0;  // written so far
+  std::vector<float> floats;
+  std::vector<unsigned char> bytes;
+};
+
+// the whole film in one go
+inline bool writeStreamImage(const Film &film, const std::string &path,
+                             const ToneMapSettings &toneMapping = {}) {
+  auto image = ImageStream::open(path, film.width, film.height, toneMapping);
+  return image && image->write(film, 0) && image->close();
+}
+
+// a color (PF) or greyscale (Pf) PFM of either byte order into 3 floats per
+// pixel, bottom row first as stored
+inline bool readPfm(const std::string &path, int &width, int &height,
+                    std::vector<float> &rgb) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    std::cerr << "[ERROR] Failed to open " << path << std::endl;
+    return false;
+  }
+  char type[3] = {};
+  float scale = 0;
+  // a single whitespace character ends the header
+  bool ok = fscanf(file, "%2s %d %d %f", type, &width, &height, &scale) == 4 &&
+            fgetc(file) != EOF && width > 0 && height > 0 && scale != 0 &&
+            (!strcmp(type, "PF") || !strcmp(type, "Pf"));
+  int channels = type[1] == 'F' ? 3 : 1;
+  size_t n = static_cast<size_t>(width) * height;
+  std::vector<float> data;
+  if (ok) {
+    data.resize(n * channels);
+    ok = fread(data.data(), sizeof(float), data.size(), file) == data.size();
+  }
+  fclose(file);
+  if (!ok) {
+    std::cerr << "[ERROR] " << path << " is not a valid PFM" << std::endl;
+    return false;
+  }
+  // a negative scale marks little-endian data
+  if ((scale < 0) != littleEndianHost()) {
+    for (float &f : data) {
+      uint8_t *b = reinterpret_cast<uint8_t *>(&f);
+      std::reverse(b, b + sizeof(float));
+    }
+  }
+  if (channels == 3) {
+    rgb = std::move(data);
+  } else {
+    rgb.resize(n * 3);
+    for (size_t i = 0; i < n; ++i)
+      rgb[i * 3 + 0] = rgb[i * 3 + 1] = rgb[i * 3 + 2] = data[i];
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef INSTANCE_H_
+#define INSTANCE_H_
+#include "Hit.h"
+#include "LinearBVH.h"
+#include "Transform.h"
+#include <cstdlib>
+#include <iostream>
+
+// a placed copy of a shared object (the bottom level). Rays are moved into
+// object space instead of copying geometry; only one level of instancing
+// is supported, i.e. object must not contain instances itself
+struct Instance : public Hitable {
+  // keep whatever material the object reports
+  static const uint32_t INHERIT_MATERIAL = UINT32_MAX;
+
+  Instance() = default;
+  Instance(std::shared_ptr<const Hitable> object,
+           const Transform &objectToWorld,
+           uint32_t materialId = INHERIT_MATERIAL)
+      : object(std::move(object)),
+        worldToObject(objectToWorld.inverse()),
+        materialId(materialId) {}
+
+  bool intersect(const Ray &r, float tMin, float tMax,
+                 Intersection &isect) const override {
+    Intersection local;
+    if (!object->intersect(worldToObject.ray(r), tMin, tMax, local))
+      return false;
+    isect = local;
+    isect.instance = this;
+    return true;
+  }
+
+  void surface(const Ray &r, const Intersection &isect,
+               HitRecord &rec) const override {
+    isect.object->surface(worldToObject.ray(r), isect, rec);
+    // an affine map keeps the sign of dot(dir, normal), so frontFace holds
+    rec.p = r.at(isect.t);
+    rec.normal = normalize(worldToObject.normal(rec.normal));
+    if (materialId != INHERIT_MATERIAL) rec.materialId = materialId;
+  }
+
+  bool boundingBox(AABB &box) const override {
+    AABB local;
+    if (!object->boundingBox(local)) return false;
+    box = worldToObject.inverse().box(local);
+    return true;
+  }
+
+  std::shared_ptr<const Hitable> object;
+  Transform worldToObject;
+  uint32_t materialId = INHERIT_MATERIAL;
+};
+
+// the top level: instances stored by value in leaf order behind a
+// flattened BVH over their world space bounds
+struct InstanceBVH : public Hitable {
+  InstanceBVH() = default;
+  InstanceBVH(const std::vector<Instance> &prims,
+              BVHBuildMethod method = BVHBuildMethod::SAH) {
+    std::vector<AABB> bounds(prims.size());
+    for (size_t i = 0; i < prims.size(); ++i) {
+      if (!prims[i].boundingBox(bounds[i])) {
+        std::cerr << "[ERROR] No bounding box in InstanceBVH constructor"
+                  << std::endl;
+        exit(-1);
+      }
+    }
+    std::vector<uint32_t> order;
+    // an instance test is a whole bottom level traversal, keep leaves small
+    buildStats = LinearBVHBuilder::build(bounds, nodes, order, 2, 1, method);
+    instances.reserve(prims.size());
+    for (auto i : order) instances.push_back(prims[i]);
+  }
+
+  bool intersect(const Ray &r, float tMin, float tMax,
+                 Intersection &isect) const override {
+    if (nodes.empty()) return false;
+    return traverseLinearBVH(
+        nodes.data(), r, tMin, tMax, [&](int offset, int count, float &tMax) {
+          bool hitAny = false;
+          for (int i = offset; i < offset + count; ++i) {
+            if (instances[i].Instance::intersect(r, tMin, tMax, isect)) {
+              tMax = isect.t;
+              hitAny = true;
+            }
+          }
+          return hitAny;
+        });
+  }
+
+  void surface(const Ray &, const Intersection &, HitRecord &) const override {
+    assert(false && "hits resolve to the instance that reported them");
+  }
+
+  bool boundingBox(AABB &box) const override {
+    if (nodes.empty()) return false;
+    box = nodes[0].box();
+    return true;
+  }
+
+  std::vector<LinearBVHNode> nodes;
+  std::vector<Instance> instances;
+  BVHBuildStats buildStats;
+};
+
+#endif
@@ -0,0 +1,454 @@
+#ifndef LINEAR_BVH_H_
+#define LINEAR_BVH_H_
+#include "AABB.h"
+#include "Stats.h"
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// depth-first flattened BVH node: the first child directly follows its
+// parent, so only the second child's index has to be stored
+struct LinearBVHNode {
+  float bounds[2][3];
+  union {
+    int32_t primitivesOffset;   // leaf
+    int32_t secondChildOffset;  // interior
+  };
+  uint16_t nPrimitives;  // 0 -> interior node
+  uint8_t axis;
+  uint8_t pad;
+
+  AABB box() const {
+    return AABB(Point3f(bounds[0][0], bounds[0][1], bounds[0][2]),
+                Point3f(bounds[1][0], bounds[1][1], bounds[1][2]));
+  }
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must be 32 bytes");
+
+// traversal keeps a fixed stack of this many nodes, so trees must be
+// shallower (LinearBVHBuilder guarantees it)
+const int LINEAR_BVH_STACK = 64;
+
+// per-ray data reused by every node test
+struct RayBoxTest {
+  RayBoxTest() = default;
+  RayBoxTest(const Ray &r) : origin(r.origin) {
+    for (int a = 0; a < 3; ++a) {
+      invDir[a] = 1.0f / r.dir[a];
+      dirIsNeg[a] = invDir[a] < 0;
+    }
+  }
+
+  bool hit(const LinearBVHNode &node, float tMin, float tMax) const {
+    for (int a = 0; a < 3; ++a) {
+      float t0 = (node.bounds[dirIsNeg[a]][a] - origin[a]) * invDir[a];
+      float t1 = (node.bounds[1 - dirIsNeg[a]][a] - origin[a]) * invDir[a];
+      tMin = t0 > tMin ? t0 : tMin;
+      tMax = t1 < tMax ? t1 : tMax;
+      if (tMax < tMin) return false;
+    }
+    return true;
+  }
+
+  Point3f origin;
+  Vec3f invDir;
+  int dirIsNeg[3];
+};
+
+enum class BVHBuildMethod {
+  SAH,   // binned surface area heuristic: slower build, faster traversal
+  LBVH,  // splits along sorted Morton codes: near linear build time
+};
+
+inline const char *bvhMethodName(BVHBuildMethod method) {
+  return method == BVHBuildMethod::LBVH ? "lbvh" : "sah";
+}
+
+inline bool parseBVHMethod(const std::string &name, BVHBuildMethod &method) {
+  if (name == "sah") {
+    method = BVHBuildMethod::SAH;
+  } else if (name == "lbvh") {
+    method = BVHBuildMethod::LBVH;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+struct BVHBuildStats {
+  BVHBuildMethod method = BVHBuildMethod::SAH;
+  double seconds = 0;
+  size_t primitives = 0;
+  size_t nodes = 0;
+  size_t leaves = 0;
+  int maxDepth = 0;
+  // expected cost of a ray through the whole tree under the SAH, in
+  // primitive tests (lower is better)
+  float sahCost = 0;
+
+  void print(std::ostream &os, const std::string &name) const {
+    os << "[INFO] " << name << " BVH (" << bvhMethodName(method)
+       << "): " << primitives << " primitives, " << nodes << " nodes, "
+       << leaves << " leaves, depth " << maxDepth << ", SAH cost " << sahCost
+       << ", " << seconds << "s" << std::endl;
+  }
+};
+
+class LinearBVHBuilder {
+ public:
+  // builds nodes over primBounds; order receives the primitive permutation
+  // that leaves index into. primsPerTest is how many primitives a leaf
+  // intersects for the cost of one (e.g. the SIMD width). Large subtrees
+  // are built on their own threads
+  static BVHBuildStats build(const std::vector<AABB> &primBounds,
+                             std::vector<LinearBVHNode> &nodes,
+                             std::vector<uint32_t> &order,
+                             int maxPrimsInNode = 4, int primsPerTest = 1,
+                             BVHBuildMethod method = BVHBuildMethod::SAH) {
+    auto start = std::chrono::high_resolution_clock::now();
+    LinearBVHBuilder builder(primBounds, maxPrimsInNode, primsPerTest,
+                             method);
+    nodes.clear();
+    order.resize(primBounds.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+    if (!order.empty()) {
+      if (method == BVHBuildMethod::LBVH) builder.sortByMorton(order);
+      // a few more subtrees than threads, as SAH splits are uneven
+      int threads = std::max(1u, std::thread::hardware_concurrency());
+      int spawnDepth = 2;
+      while ((1 << (spawnDepth - 2)) < threads) ++spawnDepth;
+      builder.recursiveBuild(nodes, order, 0, order.size(), 0, spawnDepth);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    BVHBuildStats stats = measure(nodes, primsPerTest);
+    stats.method = method;
+    stats.primitives = primBounds.size();
+    stats.seconds = std::chrono::duration<double>(end - start).count();
+    return stats;
+  }
+
+  // node counts, depth and SAH cost of a finished tree
+  static BVHBuildStats measure(const std::vector<LinearBVHNode> &nodes,
+                               int primsPerTest = 1) {
+    BVHBuildStats stats;
+    stats.nodes = nodes.size();
+    if (nodes.empty()) return stats;
+    float rootArea = nodes[0].box().area();
+    std::vector<std::pair<int, int> > stack{{0, 1}};
+    while (!stack.empty()) {
+      int index = stack.back().first, depth = stack.back().second;
+      stack.pop_back();
+      const LinearBVHNode &node = nodes[index];
+      float p = rootArea > 0 ? node.box().area() / rootArea : 1;
+      stats.maxDepth = std::max(stats.maxDepth, depth);
+      if (node.nPrimitives > 0) {
+        ++stats.leaves;
+        stats.sahCost +=
+            p * ((node.nPrimitives + primsPerTest - 1) / primsPerTest);
+      } else {
+        stats.sahCost += p * TRAVERSAL_COST;
+        stack.emplace_back(index + 1, depth + 1);
+        stack.emplace_back(node.secondChildOffset, depth + 1);
+      }
+    }
+    return stats;
+  }
+
+ private:
+  static const int BUCKETS = 12;
+  // a traversal step costs 1/8 of a primitive test
+  static constexpr float TRAVERSAL_COST = 0.125f;
+  // smaller subtrees are not worth a thread
+  static const size_t PARALLEL_MIN = 4096;
+  // below this depth every split is at the median, which adds at most
+  // log2(2^31) more levels and keeps trees within LINEAR_BVH_STACK
+  static const int MEDIAN_DEPTH = 32;
+  static_assert(MEDIAN_DEPTH + 31 < LINEAR_BVH_STACK,
+                "median splits must fit the traversal stack");
+
+  LinearBVHBuilder(const std::vector<AABB> &primBounds, int maxPrimsInNode,
+                   int primsPerTest, BVHBuildMethod method)
+      : primBounds(primBounds),
+        maxPrimsInNode(maxPrimsInNode),
+        primsPerTest(primsPerTest),
+        method(method) {
+    centroids.reserve(primBounds.size());
+    for (const auto &b : primBounds) centroids.push_back(b.centroid());
+  }
+
+  static void setBounds(LinearBVHNode &node, const AABB &box) {
+    for (int a = 0; a < 3; ++a) {
+      node.bounds[0][a] = box.min[a];
+      node.bounds[1][a] = box.max[a];
+    }
+  }
+
+  // 10 bits per axis interleaved as ...zyxzyx, x in the top bit
+  static uint32_t morton(uint32_t x, uint32_t y, uint32_t z) {
+    auto spread = [](uint32_t v) {
+      v = (v * 0x00010001u) & 0xff0000ffu;
+      v = (v * 0x00000101u) & 0x0f00f00fu;
+      v = (v * 0x00000011u) & 0xc30c30c3u;
+      v = (v * 0x00000005u) & 0x49249249u;
+      return v;
+    };
+    return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+  }
+
+  // sorts order by the Morton code of the centroids (LSD radix sort);
+  // codes[i] is the code of order[i] afterwards
+  void sortByMorton(std::vector<uint32_t> &order) {
+    AABB centroidBox;
+    for (const auto &c : centroids) centroidBox.expand(c);
+    size_t n = order.size();
+    codes.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+      uint32_t q[3];
+      for (int a = 0; a < 3; ++a) {
+        float extent = centroidBox.max[a] - centroidBox.min[a];
+        float f = extent > 0 ? (centroids[i][a] - centroidBox.min[a]) / extent
+                             : 0;
+        q[a] = std::min(1023u, static_cast<uint32_t>(f * 1024));
+      }
+      codes[i] = morton(q[0], q[1], q[2]);
+    }
+    std::vector<uint32_t> tmpOrder(n), tmpCodes(n);
+    for (int shift = 0; shift < 30; shift += 10) {
+      std::vector<size_t> count(1025, 0);
+      for (size_t i = 0; i < n; ++i) ++count[((codes[i] >> shift) & 1023) + 1];
+      for (int b = 0; b < 1024; ++b) count[b + 1] += count[b];
+      for (size_t i = 0; i < n; ++i) {
+        size_t dst = count[(codes[i] >> shift) & 1023]++;
+        tmpOrder[dst] = order[i];
+        tmpCodes[dst] = codes[i];
+      }
+      order.swap(tmpOrder);
+      codes.swap(tmpCodes);
+    }
+  }
+
+  // where to split [start, end) by the SAH, or end for a leaf
+  size_t splitSAH(std::vector<uint32_t> &order, size_t start, size_t end,
+                  const AABB &box, int axis, float lo, float hi) const {
+    size_t n = end - start;
+    auto bucketOf = [&](uint32_t prim) {
+      int b = static_cast<int>(BUCKETS * (centroids[prim][axis] - lo) /
+                               (hi - lo));
+      return std::min(b, BUCKETS - 1);
+    };
+    int count[BUCKETS] = {};
+    AABB bounds[BUCKETS];
+    for (size_t i = start; i < end; ++i) {
+      int b = bucketOf(order[i]);
+      ++count[b];
+      bounds[b].expand(primBounds[order[i]]);
+    }
+    AABB rightBounds[BUCKETS];
+    int rightCount[BUCKETS] = {};
+    for (int i = BUCKETS - 2; i >= 0; --i) {
+      rightBounds[i] = rightBounds[i + 1];
+      rightBounds[i].expand(bounds[i + 1]);
+      rightCount[i] = rightCount[i + 1] + count[i + 1];
+    }
+    float bestCost = std::numeric_limits<float>::infinity();
+    int bestSplit = 0;
+    AABB leftBounds;
+    int leftCount = 0;
+    for (int i = 0; i < BUCKETS - 1; ++i) {
+      leftBounds.expand(bounds[i]);
+      leftCount += count[i];
+      if (!leftCount || !rightCount[i]) continue;
+      float cost = TRAVERSAL_COST + (leftCount * leftBounds.area() +
+                                     rightCount[i] * rightBounds[i].area()) /
+                                        box.area();
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestSplit = i;
+      }
+    }
+    float leafCost = (n + primsPerTest - 1) / primsPerTest;
+    if (n <= static_cast<size_t>(maxPrimsInNode) && bestCost >= leafCost)
+      return end;
+    auto it = std::partition(
+        order.begin() + start, order.begin() + end,
+        [&](uint32_t prim) { return bucketOf(prim) <= bestSplit; });
+    return it - order.begin();
+  }
+
+  // first position in [start, end) whose Morton code has the highest bit
+  // that differs across the range set; axis gets that bit's axis
+  size_t splitMorton(size_t start, size_t end, int &axis) const {
+    uint32_t diff = codes[start] ^ codes[end - 1];
+    if (!diff) return start;
+    int bit = 31;
+    while (!(diff >> bit & 1)) --bit;
+    axis = 2 - bit % 3;
+    return std::partition_point(
+               codes.begin() + start, codes.begin() + end,
+               [&](uint32_t code) { return !(code >> bit & 1); }) -
+           codes.begin();
+  }
+
+  void recursiveBuild(std::vector<LinearBVHNode> &nodes,
+                      std::vector<uint32_t> &order, size_t start, size_t end,
+                      int depth, int spawnDepth) {
+    size_t nodeIndex = nodes.size();
+    nodes.emplace_back();
+    AABB box, centroidBox;
+    for (size_t i = start; i < end; ++i) {
+      box.expand(primBounds[order[i]]);
+      centroidBox.expand(centroids[order[i]]);
+    }
+    setBounds(nodes[nodeIndex], box);
+    size_t n = end - start;
+    int axis = centroidBox.maxExtent();
+    float lo = centroidBox.min[axis], hi = centroidBox.max[axis];
+
+    auto makeLeaf = [&]() {
+      nodes[nodeIndex].primitivesOffset = static_cast<int32_t>(start);
+      nodes[nodeIndex].nPrimitives = static_cast<uint16_t>(n);
+      nodes[nodeIndex].axis = 0;
+    };
+    if (n == 1 || (n <= static_cast<size_t>(maxPrimsInNode) && hi <= lo)) {
+      makeLeaf();
+      return;
+    }
+
+    size_t mid = start + n / 2;
+    if (depth >= MEDIAN_DEPTH) {
+      // only reached on skewed input, e.g. exponentially spaced primitives
+      if (n <= static_cast<size_t>(maxPrimsInNode)) {
+        makeLeaf();
+        return;
+      }
+      mid = start;
+    } else if (method == BVHBuildMethod::LBVH) {
+      if (n <= static_cast<size_t>(maxPrimsInNode)) {
+        makeLeaf();
+        return;
+      }
+      mid = splitMorton(start, end, axis);
+    } else if (hi > lo) {
+      mid = splitSAH(order, start, end, box, axis, lo, hi);
+      if (mid == end && n <= static_cast<size_t>(maxPrimsInNode)) {
+        makeLeaf();
+        return;
+      }
+    }
+    if (mid == start || mid == end) {
+      mid = start + n / 2;
+      // the codes no longer match order here, but LBVH only reads codes
+      // of ranges whose codes are all equal from now on (and past
+      // MEDIAN_DEPTH none at all)
+      std::nth_element(order.begin() + start, order.begin() + mid,
+                       order.begin() + end, [&](uint32_t a, uint32_t b) {
+                         return centroids[a][axis] < centroids[b][axis];
+                       });
+    }
+    nodes[nodeIndex].nPrimitives = 0;
+    nodes[nodeIndex].axis = static_cast<uint8_t>(axis);
+    if (spawnDepth > 0 && n >= PARALLEL_MIN) {
+      // both halves into their own arrays, then appended in depth-first
+      // order with the child offsets moved along
+      std::vector<LinearBVHNode> left, right;
+      std::thread worker([&]() {
+        recursiveBuild(left, order, start, mid, depth + 1, spawnDepth - 1);
+      });
+      recursiveBuild(right, order, mid, end, depth + 1, spawnDepth - 1);
+      worker.join();
+      append(nodes, left);
+      nodes[nodeIndex].secondChildOffset = static_cast<int32_t>(nodes.size());
+      append(nodes, right);
+      return;
+    }
+    recursiveBuild(nodes, order, start, mid, depth + 1, spawnDepth);
+    int32_t second = static_cast<int32_t>(nodes.size());
+    nodes[nodeIndex].secondChildOffset = second;
+    recursiveBuild(nodes, order, mid, end, depth + 1, spawnDepth);
+  }
+
+  static void append(std::vector<LinearBVHNode> &nodes,
+                     const std::vector<LinearBVHNode> &subtree) {
+    int32_t base = static_cast<int32_t>(nodes.size());
+    for (LinearBVHNode node : subtree) {
+      if (node.nPrimitives == 0) node.secondChildOffset += base;
+      nodes.push_back(node);
+    }
+  }
+
+  const std::vector<AABB> &primBounds;
+  std::vector<Point3f> centroids;
+  std::vector<uint32_t> codes;  // LBVH: Morton code per order position
+  int maxPrimsInNode;
+  int primsPerTest;
+  BVHBuildMethod method;
+};
+
+// walks nodes front to back; leaf(offset, count, tMax) tests a primitive
+// range and returns true (shrinking tMax) if anything closer was hit
+template <typename LeafFn>
+bool traverseLinearBVH(const LinearBVHNode *nodes, const Ray &r, float tMin,
+                       float tMax, LeafFn &&leaf) {
+  RayBoxTest test(r);
+  bool hitAny = false;
+  int stack[LINEAR_BVH_STACK];
+  int stackSize = 0;
+  int current = 0;
+  for (;;) {
+    const LinearBVHNode &node = nodes[current];
+    RT_COUNT(nodeVisits++);
+    if (test.hit(node, tMin, tMax)) {
+      if (node.nPrimitives > 0) {
+        RT_COUNT(leafPrimitives += node.nPrimitives);
+        if (leaf(node.primitivesOffset, node.nPrimitives, tMax)) hitAny = true;
+        if (stackSize == 0) break;
+        current = stack[--stackSize];
+      } else if (test.dirIsNeg[node.axis]) {
+        stack[stackSize++] = current + 1;
+        current = node.secondChildOffset;
+      } else {
+        stack[stackSize++] = node.secondChildOffset;
+        current = current + 1;
+      }
+    } else {
+      if (stackSize == 0) break;
+      current = stack[--stackSize];
+    }
+  }
+  return hitAny;
+}
+
+// whether count nodes form the depth-first layout traverseLinearBVH
+// expects: second children right after their first child's subtree, leaves
+// within [0, primitives), split axes in range and no deeper than its stack.
+// One pass, for trees read from files
+inline bool validLinearBVH(const LinearBVHNode *nodes, size_t count,
+                           size_t primitives) {
+  std::vector<size_t> pending;
+  for (size_t i = 0; i < count; ++i) {
+    const LinearBVHNode &node = nodes[i];
+    if (node.nPrimitives > 0) {
+      if (node.primitivesOffset < 0 ||
+          static_cast<size_t>(node.primitivesOffset) + node.nPrimitives >
+              primitives)
+        return false;
+      // the next node is the second child of the nearest pending parent
+      if (pending.empty()) return i + 1 == count;
+      if (pending.back() != i + 1) return false;
+      pending.pop_back();
+    } else {
+      if (node.axis > 2 || node.secondChildOffset <= 0 ||
+          static_cast<size_t>(node.secondChildOffset) <= i + 1 ||
+          static_cast<size_t>(node.secondChildOffset) >= count ||
+          pending.size() >= LINEAR_BVH_STACK)
+        return false;
+      pending.push_back(node.secondChildOffset);
+    }
+  }
+  return count == 0;
+}
+
+#endif
@@ -2,18 +2,31 @@
 #define MATERIAL_H_
 #include "Ray.h"
 #include "Hit.h"
+#include "Sampler.h"
+
+// lets batch code (e.g. the wavefront shader) pick the concrete type
+// without a virtual call per hit
+enum class MaterialKind { Lambertian, Metal, Dielectric };
 
 struct Material {
+  Material(MaterialKind kind) : kind(kind) {}
+  // materials are owned and deleted through MaterialTable's base pointers
+  virtual ~Material() = default;
+
   virtual bool scatter(const Ray &r, const HitRecord &rec, Color3f &attenuation,
-                       Ray &scattered) const = 0;
+                       Ray &scattered, Sampler &sampler) const = 0;
+
+  const MaterialKind kind;
 };
 
 struct Lambertian : public Material {
-  Lambertian(const Color3f &a) : albedo(a) {}
+  Lambertian(const Color3f &a)
+      : Material(MaterialKind::Lambertian), albedo(a) {}
 
   bool scatter(const Ray &r, const HitRecord &rec, Color3f &attenuation,
-               Ray &scattered) const override {
-    Vec3f scatterDir = rec.normal + randomUnitVector();
+               Ray &scattered, Sampler &sampler) const override {
+    RT_COUNT(scatters[static_cast<int>(MaterialKind::Lambertian)]++);
+    Vec3f scatterDir = rec.normal + sampleUnitSphere(sampler.get2D());
     scattered = Ray(rec.p, scatterDir);
     attenuation = albedo;
     return true;
@@ -23,12 +36,16 @@ struct Lambertian : public Material {
 };
 
 struct Metal : public Material {
-  Metal(const Color3f &a, float f) : albedo(a), fuzz(f < 1 ? f : 1) {}
+  Metal(const Color3f &a, float f)
+      : Material(MaterialKind::Metal), albedo(a), fuzz(f < 1 ? f : 1) {}
 
   bool scatter(const Ray &r, const HitRecord &rec, Color3f &attenuation,
-               Ray &scattered) const override {
+               Ray &scattered, Sampler &sampler) const override {
+    RT_COUNT(scatters[static_cast<int>(MaterialKind::Metal)]++);
     Vec3f reflected = reflect(normalize(r.dir), rec.normal);
-    scattered = Ray(rec.p, reflected + fuzz * randomInUnitSphere());
+    Sample2 u = sampler.get2D();
+    Vec3f perturbation = fuzz * sampleUnitBall(u, sampler.get1D());
+    scattered = Ray(rec.p, reflected + perturbation);
     attenuation = albedo;
     return dot(scattered.dir, rec.normal) > 0;
   }
@@ -38,10 +55,11 @@ struct Metal : public Material {
 };
 
 struct Dielectric : public Material {
-  Dielectric(float r) : refIdx(r) {}
+  Dielectric(float r) : Material(MaterialKind::Dielectric), refIdx(r) {}
 
   bool scatter(const Ray &r, const HitRecord &rec, Color3f &attenuation,
-               Ray &scattered) const override {
+               Ray &scattered, Sampler &sampler) const override {
+    RT_COUNT(scatters[static_cast<int>(MaterialKind::Dielectric)]++);
     attenuation = Color3f(1.0f, 1.0f, 1.0f);
     float e = rec.frontFace ? 1.0f / refIdx : refIdx;
     Vec3f unitDir = normalize(r.dir);
@@ -53,7 +71,7 @@ struct Dielectric : public Material {
       return true;
     }
     float reflectProb = schlick(cosTheta, e);
-    if (randomFloat() < reflectProb) {
+    if (sampler.get1D() < reflectProb) {
       Vec3f reflected = reflect(unitDir, rec.normal);
       scattered = Ray(rec.p, reflected);
       return true;
@@ -66,4 +84,7 @@ struct Dielectric : public Material {
   float refIdx;
 };
 
+// scene-owned materials, referenced from hit records by index
+using MaterialTable = std::vector<std::unique_ptr<Material> >;
+
 #endif
\ No newline at end of file
@@ -3,34 +3,26 @@
 #include <cmath>
 #include <iostream>
 #include <random>
+#include "Random.h"
 
-inline float randomFloat() { return rand() / (RAND_MAX + 1.0f); }
+inline float randomFloat(Rng &rng) { return rng.nextFloat(); }
 
-inline float randomFloat(float min, float max) {
-  return min + (max - min) * randomFloat();
+inline float randomFloat(Rng &rng, float min, float max) {
+  return min + (max - min) * randomFloat(rng);
 }
 
 inline float clamp(float x, float min, float max) {
   return x < min ? min : (x > max ? max : x);
 }
 
+// plain members rather than a union of anonymous structs (a compiler
+// extension, and reading r after writing x is type punning); colors use the
+// r() / g() / b() accessors. The layout is still 3 packed Ts
 template <typename T>
 struct Vec3 {
-  union {
-    struct {
-      T x;
-      T y;
-      T z;
-    };
-    struct {
-      T r;
-      T g;
-      T b;
-    };
-    T a[3];
-  };
-
-  Vec3() : a() {}
+  T x, y, z;
+
+  Vec3() : x(), y(), z() {}
   Vec3(T x, T y, T z) : x(x), y(y), z(z) {}
 
   Vec3 operator-() const { return {-x, -y, -z}; }
@@ -55,6 +47,8 @@ struct Vec3 {
     z *= t;
     return *this;
   }
+  // one division and three multiplications; dividing each component
+  // would cost three divisions and change every rendered image
   Vec3 operator/(T t) const { return *this * (1 / t); }
   Vec3 &operator/=(T t) { return *this *= 1 / t; }
 
@@ -63,22 +57,29 @@ struct Vec3 {
   T length2() const { return x * x + y * y + z * z; }
   T norm2() const { return x * x + y * y + z * z; }
 
-  T &operator[](int i) { return a[i]; }
-  T operator[](int i) const { return a[i]; }
+  T &operator[](int i) { return i == 0 ? x : (i == 1 ? y : z); }
+  T operator[](int i) const { return i == 0 ? x : (i == 1 ? y : z); }
+
+  T &r() { return x; }
+  T &g() { return y; }
+  T &b() { return z; }
+  T r() const { return x; }
+  T g() const { return y; }
+  T b() const { return z; }
 
   T dot(const Vec3 &o) const { return x * o.x + y * o.y + z * o.z; }
   Vec3 cross(const Vec3 &o) const {
     return {y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x};
   }
 
-  Vec3 &normalize() { *this /= norm(); }
+  Vec3 &normalize() { return *this /= norm(); }
 
   Vec3 normalized() const { return *this / norm(); }
 };
 
 template <typename T>
 std::ostream &operator<<(std::ostream &os, const Vec3<T> &c) {
-  os << '(' << c.r << ", " << c.g << ", " << c.b << ')';
+  os << '(' << c.x << ", " << c.y << ", " << c.z << ')';
   return os;
 }
 
@@ -111,18 +112,35 @@ using Vec3f = Vec3<float>;
 using Color3f = Vec3f;
 using Point3f = Vec3f;
 
-inline Vec3f randomVec3f() {
-  return Vec3f(randomFloat(), randomFloat(), randomFloat());
+inline float luminance(const Color3f &c) {
+  return 0.2126f * c.r() + 0.7152f * c.g() + 0.0722f * c.b();
+}
+
+// maps t in [0, 1] to a blue-green-red ramp
+inline Color3f heatColor(float t) {
+  t = clamp(t, 0, 1);
+  return Color3f(clamp(1.5f - std::abs(4 * t - 3), 0, 1),
+                 clamp(1.5f - std::abs(4 * t - 2), 0, 1),
+                 clamp(1.5f - std::abs(4 * t - 1), 0, 1));
+}
+
+inline Vec3f randomVec3f(Rng &rng) {
+  float x = randomFloat(rng);
+  float y = randomFloat(rng);
+  float z = randomFloat(rng);
+  return Vec3f(x, y, z);
 }
 
-inline Vec3f randomVec3f(float min, float max) {
-  return Vec3f(randomFloat(min, max), randomFloat(min, max),
-               randomFloat(min, max));
+inline Vec3f randomVec3f(Rng &rng, float min, float max) {
+  float x = randomFloat(rng, min, max);
+  float y = randomFloat(rng, min, max);
+  float z = randomFloat(rng, min, max);
+  return Vec3f(x, y, z);
 }
 
-Vec3f randomInUnitSphere() {
+inline Vec3f randomInUnitSphere(Rng &rng) {
   for (;;) {
-    auto p = randomVec3f(-1, 1);
+    auto p = randomVec3f(rng, -1, 1);
     if (p.norm2() >= 1) continue;
     return p;
   }
@@ -130,15 +148,15 @@ Vec3f randomInUnitSphere() {
 
 const float PI = acos(-1);
 
-Vec3f randomUnitVector() {
-  float a = randomFloat(0, 2 * PI);
-  float z = randomFloat(-1, 1);
+inline Vec3f randomUnitVector(Rng &rng) {
+  float a = randomFloat(rng, 0, 2 * PI);
+  float z = randomFloat(rng, -1, 1);
   float r = sqrt(1 - z * z);
   return Vec3f(r * cos(a), r * sin(a), z);
 }
 
-Vec3f randomInHemisphere(const Vec3f &normal) {
-  Vec3f inUnitSphere = randomInUnitSphere();
+inline Vec3f randomInHemisphere(Rng &rng, const Vec3f &normal) {
+  Vec3f inUnitSphere = randomInUnitSphere(rng);
   return dot(inUnitSphere, normal) > 0 ? inUnitSphere : -inUnitSphere;
 }
 
@@ -149,19 +167,24 @@ inline Vec3f reflect(const Vec3f &v, const Vec3f &n) {
 inline Vec3f refract(const Vec3f &uv, const Vec3f &n, float e) {
   float cosTheta = dot(-uv, n);
   Vec3f r1 = e * (uv + cosTheta * n);
-  Vec3f r2 = -sqrt(1 - r1.norm2()) * n;
+  Vec3f r2 = -std::sqrt(1 - r1.norm2()) * n;
   return r1 + r2;
 }
 
 inline float schlick(float cosine, float refIdx) {
   float r0 = (1 - refIdx) / (1 + refIdx);
   r0 *= r0;
-  return r0 + (1 - r0) * pow(1 - cosine, 5);
+  // x^5 by multiplication, pow on a float promotes to double
+  float x = 1 - cosine;
+  float x2 = x * x;
+  return r0 + (1 - r0) * (x2 * x2 * x);
 }
 
-Vec3f randomInUnitDisk() {
+inline Vec3f randomInUnitDisk(Rng &rng) {
   for (;;) {
-    auto p = Vec3f(randomFloat(-1, 1), randomFloat(-1, 1), 0);
+    float x = randomFloat(rng, -1, 1);
+    float y = randomFloat(rng, -1, 1);
+    auto p = Vec3f(x, y, 0);
     if (p.norm2() >= 1) continue;
     return p;
   }
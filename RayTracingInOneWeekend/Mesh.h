@@ -0,0 +1,234 @@
+#ifndef MESH_H_
+#define MESH_H_
+#include "Hit.h"
+#include "LinearBVH.h"
+#include "FlatArray.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// indexed triangle mesh behind its own flattened BVH. Vertices and indices
+// live in flat arrays; triangles are reordered so that leaves index a
+// contiguous range of them
+struct TriangleMesh : public Hitable {
+  TriangleMesh() = default;
+  TriangleMesh(std::vector<Point3f> positions, std::vector<uint32_t> indices,
+               uint32_t materialId, std::vector<Vec3f> normals = {},
+               BVHBuildMethod method = BVHBuildMethod::SAH)
+      : positions(std::move(positions)),
+        normals(std::move(normals)),
+        indices(std::move(indices)),
+        materialId(materialId) {
+    build(method);
+  }
+
+  size_t triangleCount() const { return indices.size() / 3; }
+
+  // (re)builds the BVH after positions or indices changed
+  void build(BVHBuildMethod method = BVHBuildMethod::SAH) {
+    size_t n = triangleCount();
+    std::vector<AABB> bounds(n);
+    for (size_t i = 0; i < n; ++i) {
+      for (int k = 0; k < 3; ++k) bounds[i].expand(vertex(i, k));
+    }
+    std::vector<LinearBVHNode> tree;
+    std::vector<uint32_t> order;
+    buildStats = LinearBVHBuilder::build(bounds, tree, order, 4, 1, method);
+    nodes = std::move(tree);
+    std::vector<uint32_t> sorted(indices.size());
+    for (size_t i = 0; i < n; ++i) {
+      for (int k = 0; k < 3; ++k)
+        sorted[3 * i + k] = indices[3 * order[i] + k];
+    }
+    indices = std::move(sorted);
+  }
+
+  // Möller–Trumbore; barycentrics of the hit go to u, v
+  bool intersectTriangle(const Ray &r, size_t i, float tMin, float tMax,
+                         float &t, float &u, float &v) const {
+    const Point3f &p0 = vertex(i, 0);
+    Vec3f e1 = vertex(i, 1) - p0;
+    Vec3f e2 = vertex(i, 2) - p0;
+    Vec3f pv = cross(r.dir, e2);
+    float det = dot(e1, pv);
+    if (det == 0) return false;
+    float invDet = 1 / det;
+    Vec3f tv = r.origin - p0;
+    u = dot(tv, pv) * invDet;
+    if (u < 0 || u > 1) return false;
+    Vec3f qv = cross(tv, e1);
+    v = dot(r.dir, qv) * invDet;
+    if (v < 0 || u + v > 1) return false;
+    t = dot(e2, qv) * invDet;
+    return t > tMin && t < tMax;
+  }
+
+  bool intersect(const Ray &r, float tMin, float tMax,
+                 Intersection &isect) const override {
+    if (nodes.empty()) return false;
+    int closest = -1;
+    float tHit = tMax;
+    traverseLinearBVH(nodes.data(), r, tMin, tMax,
+                      [&](int offset, int count, float &tMax) {
+                        bool hitAny = false;
+                        float t, u, v;
+                        for (int i = offset; i < offset + count; ++i) {
+                          if (intersectTriangle(r, i, tMin, tMax, t, u, v)) {
+                            tMax = t;
+                            closest = i;
+                            hitAny = true;
+                          }
+                        }
+                        if (hitAny) tHit = tMax;
+                        return hitAny;
+                      });
+    if (closest < 0) return false;
+    isect.t = tHit;
+    isect.primId = static_cast<uint32_t>(closest);
+    isect.object = this;
+    isect.instance = nullptr;
+    return true;
+  }
+
+  void surface(const Ray &r, const Intersection &isect,
+               HitRecord &rec) const override {
+    size_t i = isect.primId;
+    rec.t = isect.t;
+    rec.p = r.at(rec.t);
+    rec.materialId = materialId;
+    Vec3f outward;
+    float t, u, v;
+    // the hit is recomputed once to get the barycentrics for smooth normals
+    if (!normals.empty() &&
+        intersectTriangle(r, i, -std::numeric_limits<float>::infinity(),
+                          std::numeric_limits<float>::infinity(), t, u, v)) {
+      outward = normals[indices[3 * i]] * (1 - u - v) +
+                normals[indices[3 * i + 1]] * u +
+                normals[indices[3 * i + 2]] * v;
+    }
+    if (outward.norm2() == 0)
+      outward = cross(vertex(i, 1) - vertex(i, 0), vertex(i, 2) - vertex(i, 0));
+    rec.setFaceNormal(r, outward.normalized());
+  }
+
+  bool boundingBox(AABB &box) const override {
+    if (nodes.empty()) return false;
+    box = nodes[0].box();
+    return true;
+  }
+
+  const Point3f &vertex(size_t triangle, int k) const {
+    return positions[indices[3 * triangle + k]];
+  }
+
+  FlatArray<Point3f> positions;
+  FlatArray<Vec3f> normals;     // per vertex, optional
+  FlatArray<uint32_t> indices;  // three per triangle
+  uint32_t materialId = 0;
+  FlatArray<LinearBVHNode> nodes;
+  BVHBuildStats buildStats;
+};
+
+// reads the v, vn and f records of a Wavefront OBJ file (other records are
+// skipped); polygons are triangulated as fans, negative indices are
+// relative. Normals are kept per position, so a position referenced with
+// different normals keeps the last one
+inline bool loadObj(const std::string &path, uint32_t materialId,
+                    TriangleMesh &mesh,
+                    BVHBuildMethod method = BVHBuildMethod::SAH) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    std::cerr << "[ERROR] Failed to open " << path << std::endl;
+    return false;
+  }
+  std::string text;
+  char buffer[1 << 16];
+  size_t read;
+  while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    text.append(buffer, read);
+  fclose(file);
+
+  std::vector<Point3f> positions;
+  std::vector<Vec3f> objNormals;
+  std::vector<uint32_t> indices;
+  std::vector<std::pair<uint32_t, uint32_t> > normalOf;  // position, normal
+  std::vector<uint32_t> face;
+  auto resolve = [](long index, size_t count) -> long {
+    return index < 0 ? static_cast<long>(count) + index : index - 1;
+  };
+
+  const char *s = text.c_str();
+  int line = 1;
+  while (*s) {
+    const char *end = strchr(s, '\n');
+    if (!end) end = s + strlen(s);
+    while (*s == ' ' || *s == '\t') ++s;
+    if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t')) {
+      char *p;
+      float x = strtof(s + 2, &p);
+      float y = strtof(p, &p);
+      float z = strtof(p, &p);
+      positions.emplace_back(x, y, z);
+    } else if (s[0] == 'v' && s[1] == 'n') {
+      char *p;
+      float x = strtof(s + 2, &p);
+      float y = strtof(p, &p);
+      float z = strtof(p, &p);
+      objNormals.emplace_back(x, y, z);
+    } else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t')) {
+      face.clear();
+      const char *p = s + 1;
+      while (p < end) {
+        char *q;
+        long vi = strtol(p, &q, 10);
+        if (q == p) break;
+        long v = resolve(vi, positions.size());
+        if (v < 0 || v >= static_cast<long>(positions.size())) {
+          std::cerr << "[ERROR] Bad vertex index in " << path << ":" << line
+                    << std::endl;
+          return false;
+        }
+        p = q;
+        // optional /vt and /vn
+        if (*p == '/') {
+          ++p;
+          if (*p != '/') {
+            strtol(p, &q, 10);
+            p = q;
+          }
+          if (*p == '/') {
+            ++p;
+            long ni = strtol(p, &q, 10);
+            if (q != p) {
+              long n = resolve(ni, objNormals.size());
+              if (n >= 0 && n < static_cast<long>(objNormals.size()))
+                normalOf.emplace_back(v, n);
+              p = q;
+            }
+          }
+        }
+        face.push_back(static_cast<uint32_t>(v));
+      }
+      for (size_t k = 2; k < face.size(); ++k) {
+        indices.push_back(face[0]);
+        indices.push_back(face[k - 1]);
+        indices.push_back(face[k]);
+      }
+    }
+    s = *end ? end + 1 : end;
+    ++line;
+  }
+
+  std::vector<Vec3f> normals;
+  if (!normalOf.empty()) {
+    normals.assign(positions.size(), Vec3f());
+    for (const auto &pn : normalOf) normals[pn.first] = objNormals[pn.second];
+  }
+  mesh = TriangleMesh(std::move(positions), std::move(indices), materialId,
+                      std::move(normals), method);
+  return true;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef RANDOM_H_
+#define RANDOM_H_
+#include <cstdint>
+
+inline uint64_t mixBits(uint64_t v) {
+  v ^= v >> 31;
+  v *= 0x7fb5d329728ea185ull;
+  v ^= v >> 27;
+  v *= 0x81dadef4bc2dd44dull;
+  v ^= v >> 33;
+  return v;
+}
+
+// PCG32 (O'Neill), small enough to keep one per path
+struct Rng {
+  Rng() = default;
+  Rng(uint64_t seqIndex, uint64_t seed) { setSequence(seqIndex, seed); }
+  explicit Rng(uint64_t seqIndex) { setSequence(seqIndex, mixBits(seqIndex)); }
+
+  // an independent, reproducible stream for every (pixel, sample) pair
+  static Rng forSample(uint64_t pixel, uint64_t sample, uint64_t seed = 0) {
+    return Rng(mixBits(pixel ^ mixBits(seed)), mixBits(sample + 1));
+  }
+
+  void setSequence(uint64_t seqIndex, uint64_t seed) {
+    state = 0;
+    inc = (seqIndex << 1) | 1;
+    nextUInt();
+    state += seed;
+    nextUInt();
+  }
+
+  uint32_t nextUInt() {
+    uint64_t old = state;
+    state = old * 0x5851f42d4c957f2dull + inc;
+    uint32_t xorShifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+    uint32_t rot = static_cast<uint32_t>(old >> 59);
+    return (xorShifted >> rot) | (xorShifted << ((~rot + 1) & 31));
+  }
+
+  // uniform in [0, 1)
+  float nextFloat() { return (nextUInt() >> 8) * 0x1p-24f; }
+
+  uint64_t state = 0x853c49e6748fea9bull;
+  uint64_t inc = 0xda3e39cb94b95bdbull;
+};
+
+#endif
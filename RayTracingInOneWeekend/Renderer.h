@@ -0,0 +1,218 @@
+#ifndef RENDERER_H_
+#define RENDERER_H_
+#include "Camera.h"
+#include "Film.h"
+#include "Hit.h"
+#include "Material.h"
+#include "Stats.h"
+#include "TileScheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <limits>
+
+struct RenderSettings {
+  int width = 1920;
+  int height = 1080;
+  // the most samples a pixel gets (adaptive mode may stop earlier)
+  int spp = 64;
+  int maxDepth = 50;
+  // bounces before Russian roulette may end a path (< 0 -> never)
+  int rouletteDepth = 3;
+  // upper bound of a path's survival probability under Russian roulette
+  float rouletteMaxSurvival = 0.95f;
+  int tileSize = 32;
+  // 0 -> one thread per hardware thread
+  int threads = 0;
+  uint64_t seed = 0;
+  // how pixel, lens and scattering samples are placed (see Sampler.h);
+  // stratified strata are rounds of spp samples
+  SamplerKind sampler = SamplerKind::Sobol;
+  // render the whole frame one sample per pixel at a time, reporting the
+  // film after every pass
+  bool progressive = true;
+  // seconds, progressive mode stops after the pass that exceeds it (0 -> none)
+  double timeBudget = 0;
+  // keep sampling a pixel only while its 95% confidence interval is wider
+  // than adaptiveThreshold of its mean luminance, after at least minSpp
+  bool adaptive = false;
+  int minSpp = 16;
+  float adaptiveThreshold = 0.05f;
+  // render only image rows [bandY0, bandY0 + bandHeight) into a film that
+  // tall, so streamed output never holds the whole frame (0 -> all rows)
+  int bandY0 = 0;
+  int bandHeight = 0;
+
+  // record render time and rays per pixel in Renderer::costs
+  bool pixelCosts = false;
+
+  int filmHeight() const { return bandHeight > 0 ? bandHeight : height; }
+};
+
+struct RenderStats {
+  double seconds = 0;
+  long long samples = 0;
+  long long rays = 0;
+};
+
+// iterative path tracer: throughput is carried along the path instead of
+// being multiplied in on the way back up a recursion. After rouletteDepth
+// bounces a path survives with probability max(throughput) (capped) and is
+// reweighted, so low-contribution paths end early without bias
+inline Color3f rayColor(const Ray &primary, const Hitable &objs,
+                        const MaterialTable &materials,
+                        const RenderSettings &settings, Sampler &sampler,
+                        long long &rays) {
+  Ray r = primary;
+  Color3f throughput(1.0f, 1.0f, 1.0f);
+  HitRecord rec;
+  for (int depth = 0; depth < settings.maxDepth; ++depth) {
+    ++rays;
+    RT_COUNT(rays[std::min(depth, RenderCounters::DEPTHS - 1)]++);
+    if (!objs.hit(r, 0.001, std::numeric_limits<float>::infinity(), rec)) {
+      RT_COUNT(misses++);
+      auto uDir = normalize(r.dir);
+      float t = 0.5f * (uDir.y + 1);
+      return throughput *
+             ((1 - t) * Vec3f(1.0f, 1.0f, 1.0f) + t * Vec3f(0.5f, 0.7f, 1.0f));
+    }
+    RT_COUNT(hits++);
+    Ray scattered;
+    Color3f attenuation;
+    const Material &material = *materials[rec.materialId];
+    if (!material.scatter(r, rec, attenuation, scattered, sampler)) {
+      RT_COUNT(absorbed++);
+      break;
+    }
+    throughput = throughput * attenuation;
+    r = scattered;
+    if (settings.rouletteDepth >= 0 && depth + 1 >= settings.rouletteDepth) {
+      float survive = std::min(
+          std::max({throughput.r(), throughput.g(), throughput.b()}),
+          settings.rouletteMaxSurvival);
+      if (sampler.get1D() >= survive) {
+        RT_COUNT(rouletteKills++);
+        break;
+      }
+      throughput /= survive;
+    }
+  }
+  return Color3f(0, 0, 0);
+}
+
+class Renderer {
+ public:
+  Renderer(const RenderSettings &settings, const Camera &cam,
+           const Hitable &world, const MaterialTable &materials)
+      : settings(settings),
+        cam(cam),
+        world(world),
+        materials(materials),
+        film(settings.width, settings.filmHeight()),
+        scheduler(settings.width, settings.filmHeight(), settings.tileSize,
+                  settings.threads),
+        counters(scheduler.threadCount()) {
+    if (settings.pixelCosts) {
+      costs.seconds.assign(film.sum.size(), 0.0f);
+      costs.rays.assign(film.sum.size(), 0);
+    }
+  }
+
+  // onPass(film) runs on the calling thread after every pass
+  RenderStats render(const std::function<void(const Film &)> &onPass = {}) {
+    auto start = std::chrono::high_resolution_clock::now();
+    RenderStats stats;
+    auto elapsed = [&]() {
+      auto now = std::chrono::high_resolution_clock::now();
+      return std::chrono::duration<double>(now - start).count();
+    };
+    if (settings.progressive) {
+      for (;;) {
+        long long samples = renderPass(1, stats);
+        if (onPass) onPass(film);
+        if (samples == 0) break;
+        if (settings.timeBudget > 0 && elapsed() >= settings.timeBudget)
+          break;
+      }
+    } else {
+      renderPass(settings.spp, stats);
+      if (onPass) onPass(film);
+    }
+    stats.seconds = elapsed();
+    return stats;
+  }
+
+  const RenderSettings settings;
+  const Camera &cam;
+  const Hitable &world;
+  const MaterialTable &materials;
+  Film film;
+  TileScheduler scheduler;
+  // per scheduler thread, summed over passes (see Stats.h)
+  std::vector<RenderCounters> counters;
+  // film-sized, with settings.pixelCosts only
+  struct PixelCosts {
+    std::vector<float> seconds;
+    std::vector<uint32_t> rays;
+  } costs;
+
+ private:
+  // up to n more samples for every pixel that still needs them; the sample
+  // index is the pixel's own count, so pixels stay deterministic
+  long long renderPass(int n, RenderStats &stats) {
+    std::atomic<long long> samples(0), rays(0);
+    const int width = settings.width, height = settings.height;
+    scheduler.run([&](const Tile &tile, int thread) {
+      CounterScope scope(counters[thread]);
+      long long tileSamples = 0, tileRays = 0;
+      for (int j = tile.y0; j < tile.y1; ++j) {
+        for (int i = tile.x0; i < tile.x1; ++i) {
+          auto pixelStart = std::chrono::high_resolution_clock::time_point();
+          long long pixelRays = tileRays;
+          if (settings.pixelCosts)
+            pixelStart = std::chrono::high_resolution_clock::now();
+          for (int k = 0; k < n; ++k) {
+            int s = film.samples(i, j);
+            if (s >= settings.spp) break;
+            if (settings.adaptive &&
+                film.converged(i, j, settings.minSpp,
+                               settings.adaptiveThreshold))
+              break;
+            // film row j is image row y
+            int y = j + settings.bandY0;
+            Sampler sampler(settings.sampler,
+                            static_cast<uint64_t>(y) * width + i, s,
+                            settings.spp, settings.seed);
+            Sample2 jitter = sampler.get2D();
+            float u = (i + jitter.x) / width;
+            float v = (y + jitter.y) / height;
+            Ray r = cam.getRay(u, v, sampler);
+            film.add(i, j, rayColor(r, world, materials, settings, sampler,
+                                    tileRays));
+            ++tileSamples;
+            RT_COUNT(samples++);
+          }
+          if (settings.pixelCosts) {
+            auto now = std::chrono::high_resolution_clock::now();
+            size_t p = static_cast<size_t>(j) * width + i;
+            costs.seconds[p] +=
+                std::chrono::duration<float>(now - pixelStart).count();
+            costs.rays[p] += static_cast<uint32_t>(tileRays - pixelRays);
+          }
+        }
+      }
+      samples += tileSamples;
+      rays += tileRays;
+    });
+    if (STATS_ENABLED) {
+      for (const auto &s : scheduler.getStats())
+        counters[s.thread].busySeconds += s.seconds;
+    }
+    stats.samples += samples;
+    stats.rays += rays;
+    return samples;
+  }
+};
+
+#endif
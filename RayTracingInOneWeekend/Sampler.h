@@ -0,0 +1,216 @@
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+#include "Math.h"
+#include "Random.h"
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+// how the numbers of a pixel sample are chosen: independent uniform
+// numbers, jittered strata of each round of spp samples, or Owen-scrambled
+// Sobol points (any prefix of 2^k samples is well distributed, so it also
+// suits progressive and adaptive renders)
+enum class SamplerKind { Independent, Stratified, Sobol };
+
+inline const char *samplerName(SamplerKind kind) {
+  switch (kind) {
+    case SamplerKind::Independent:
+      return "independent";
+    case SamplerKind::Stratified:
+      return "stratified";
+    default:
+      return "sobol";
+  }
+}
+
+inline bool parseSamplerKind(const std::string &name, SamplerKind &kind) {
+  if (name == "independent") {
+    kind = SamplerKind::Independent;
+  } else if (name == "stratified") {
+    kind = SamplerKind::Stratified;
+  } else if (name == "sobol") {
+    kind = SamplerKind::Sobol;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+struct Sample2 {
+  float x, y;
+};
+
+namespace sampler_detail {
+
+inline float toFloat(uint32_t bits) { return (bits >> 8) * 0x1p-24f; }
+
+inline uint32_t hash(uint64_t a, uint64_t b) {
+  return static_cast<uint32_t>(mixBits(a ^ mixBits(b + 1)));
+}
+
+inline uint32_t reverseBits(uint32_t x) {
+  x = (x << 16) | (x >> 16);
+  x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+  x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+  x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+  x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+  return x;
+}
+
+// Owen scrambling in base 2 (Burley, "Practical Hash-based Owen
+// Scrambling"): every bit is flipped by a hash of the bits above it
+inline uint32_t owenScramble(uint32_t x, uint32_t seed) {
+  x = reverseBits(x);
+  x ^= x * 0x3d20adeau;
+  x += seed;
+  x *= (seed >> 16) | 1;
+  x ^= x * 0x05526c56u;
+  x ^= x * 0x53a22864u;
+  return reverseBits(x);
+}
+
+// the first two Sobol dimensions; the first is the van der Corput sequence
+inline uint32_t sobol0(uint32_t i) { return reverseBits(i); }
+
+inline uint32_t sobol1(uint32_t i) {
+  uint32_t r = 0;
+  for (uint32_t v = 1u << 31; i; i >>= 1, v ^= v >> 1)
+    if (i & 1) r ^= v;
+  return r;
+}
+
+// element i of a pseudo-random permutation of [0, n) picked by seed
+// (Kensler, "Correlated Multi-Jittered Sampling")
+inline uint32_t permute(uint32_t i, uint32_t n, uint32_t seed) {
+  uint32_t w = n - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  do {
+    i ^= seed;
+    i *= 0xe170893du;
+    i ^= seed >> 16;
+    i ^= (i & w) >> 4;
+    i ^= seed >> 8;
+    i *= 0x0929eb3fu;
+    i ^= seed >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | seed >> 27;
+    i *= 0x6935fa69u;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303u;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3u;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3dfu;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= n);
+  return (i + seed) % n;
+}
+
+}  // namespace sampler_detail
+
+// the numbers of sample `index` of one pixel, drawn in a fixed order of
+// dimensions: pixel jitter (2D), lens (2D), then per bounce whatever the
+// material and Russian roulette ask for. Each dimension is scrambled by
+// its own hash of pixel, dimension and seed, so dimensions don't
+// correlate with each other or across pixels. Like Rng::forSample it
+// depends on nothing but its arguments, so samples stay reproducible
+// under any split of the work. Small enough to keep one per path
+class Sampler {
+ public:
+  Sampler() = default;
+  Sampler(SamplerKind kind, uint64_t pixel, uint32_t index, uint32_t spp,
+          uint64_t seed = 0)
+      : rng(Rng::forSample(pixel, index, seed)),
+        pixelKey(mixBits(pixel ^ mixBits(seed))),
+        index(index),
+        spp(spp > 0 ? spp : 1),
+        kind(kind) {}
+
+  float get1D() {
+    using namespace sampler_detail;
+    uint32_t key = hash(pixelKey, dimension++);
+    switch (kind) {
+      case SamplerKind::Independent:
+        return rng.nextFloat();
+      case SamplerKind::Stratified: {
+        uint32_t stratum = permute(index % spp, spp, hash(key, index / spp));
+        return (stratum + rng.nextFloat()) / spp;
+      }
+      default:
+        return toFloat(owenScramble(sobol0(owenScramble(index, key)),
+                                    hash(key, 0)));
+    }
+  }
+
+  Sample2 get2D() {
+    using namespace sampler_detail;
+    uint32_t key = hash(pixelKey, dimension++);
+    switch (kind) {
+      case SamplerKind::Independent: {
+        float x = rng.nextFloat();
+        return Sample2{x, rng.nextFloat()};
+      }
+      case SamplerKind::Stratified: {
+        // a grid of at least spp cells, each round of spp samples in
+        // distinct ones
+        uint32_t nx = 1;
+        while (nx * nx < spp) ++nx;
+        uint32_t ny = (spp + nx - 1) / nx;
+        uint32_t cell =
+            permute(index % spp, nx * ny, hash(key, index / spp));
+        float x = (cell % nx + rng.nextFloat()) / nx;
+        return Sample2{x, (cell / nx + rng.nextFloat()) / ny};
+      }
+      default: {
+        // the index is shuffled per dimension, which keeps every aligned
+        // block of 2^k samples a (0, 2)-net
+        uint32_t i = owenScramble(index, key);
+        return Sample2{toFloat(owenScramble(sobol0(i), hash(key, 0))),
+                       toFloat(owenScramble(sobol1(i), hash(key, 1)))};
+      }
+    }
+  }
+
+ private:
+  Rng rng;
+  uint64_t pixelKey = 0;
+  uint32_t index = 0, spp = 1;
+  uint32_t dimension = 0;
+  SamplerKind kind = SamplerKind::Independent;
+};
+
+// warps from the unit square (and cube) to the shapes the renderer samples
+
+// concentric mapping (Shirley and Chiu), keeps strata compact
+inline Vec3f sampleUnitDisk(Sample2 u) {
+  float x = 2 * u.x - 1, y = 2 * u.y - 1;
+  if (x == 0 && y == 0) return Vec3f(0, 0, 0);
+  float r, theta;
+  if (std::abs(x) > std::abs(y)) {
+    r = x;
+    theta = PI / 4 * (y / x);
+  } else {
+    r = y;
+    theta = PI / 2 - PI / 4 * (x / y);
+  }
+  return Vec3f(r * std::cos(theta), r * std::sin(theta), 0);
+}
+
+inline Vec3f sampleUnitSphere(Sample2 u) {
+  float z = 1 - 2 * u.y;
+  float r = std::sqrt(std::max(0.0f, 1 - z * z));
+  float a = 2 * PI * u.x;
+  return Vec3f(r * std::cos(a), r * std::sin(a), z);
+}
+
+// uniform in the unit ball
+inline Vec3f sampleUnitBall(Sample2 u, float w) {
+  return sampleUnitSphere(u) * std::cbrt(w);
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+#include "Sphere.h"
+#include "Material.h"
+#include "BVH.h"
+#include "SphereBVH.h"
+#include "Mesh.h"
+#include "Instance.h"
+#include "Camera.h"
+#include <string>
+
+struct CameraSettings {
+  Point3f lookfrom = Point3f(13, 2, 3);
+  Point3f lookat = Point3f(0, 0, 0);
+  Vec3f up = Vec3f(0, 1, 0);
+  float fov = 20;
+  float aperture = 0.1f;
+  float focusDis = 10;
+
+  Camera makeCamera(float aspectRatio) const {
+    return Camera(lookfrom, lookat, up, fov, aspectRatio, aperture, focusDis);
+  }
+};
+
+struct Scene {
+  template <typename M, typename... Args>
+  uint32_t addMaterial(Args &&... args) {
+    materials.push_back(std::make_unique<M>(std::forward<Args>(args)...));
+    return static_cast<uint32_t>(materials.size() - 1);
+  }
+
+  MaterialTable materials;
+  std::vector<Sphere> spheres;
+  std::vector<std::shared_ptr<TriangleMesh> > meshes;
+  std::vector<Instance> instances;
+  // prebuilt tree over the spheres (e.g. from a scene cache), used instead
+  // of spheres when set
+  std::shared_ptr<SphereBVH> sphereBVH;
+  CameraSettings camera;
+  // how the acceleration structures of this scene are built
+  BVHBuildMethod bvh = BVHBuildMethod::SAH;
+};
+
+// small spheres on a (2 * extent)^2 grid around three big ones; instanced
+// makes the small ones copies of one shared unit sphere
+inline void addRandomSpheres(Scene &scene, uint64_t seed = 0, int extent = 11,
+                             bool instanced = false) {
+  Rng rng(seed);
+  auto &world = scene.spheres;
+  auto unitSphere = std::make_shared<SphereBVH>(
+      std::vector<Sphere>{Sphere(Point3f(0, 0, 0), 1.0f, 0)});
+  auto addSmall = [&](const Point3f &center, uint32_t material) {
+    if (instanced) {
+      scene.instances.emplace_back(
+          unitSphere, Transform::translate(center) * Transform::scale(0.2f),
+          material);
+    } else {
+      world.emplace_back(center, 0.2f, material);
+    }
+  };
+  auto groundMaterial = scene.addMaterial<Lambertian>(Color3f(0.5, 0.5, 0.5));
+  world.emplace_back(Point3f(0, -1000, 0), 1000.0f, groundMaterial);
+  for (int a = -extent; a < extent; ++a) {
+    for (int b = -extent; b < extent; ++b) {
+      float chooseMat = randomFloat(rng);
+      float dx = 0.9f * randomFloat(rng);
+      float dz = 0.9f * randomFloat(rng);
+      Point3f center(a + dx, 0.2, b + dz);
+      if ((center - Point3f(4, 0.2, 0)).norm() > 0.9) {
+        uint32_t sphereMaterial;
+        if (chooseMat < 0.8) {
+          // diffuse
+          auto albedo = randomVec3f(rng);
+          albedo = albedo * randomVec3f(rng);
+          sphereMaterial = scene.addMaterial<Lambertian>(albedo);
+          addSmall(center, sphereMaterial);
+        } else if (chooseMat < 0.95) {
+          // metal
+          auto albedo = randomVec3f(rng, 0.5, 1);
+          auto fuzz = randomFloat(rng, 0, 0.5);
+          sphereMaterial = scene.addMaterial<Metal>(albedo, fuzz);
+          addSmall(center, sphereMaterial);
+        } else {
+          // glass
+          sphereMaterial = scene.addMaterial<Dielectric>(1.5f);
+          addSmall(center, sphereMaterial);
+        }
+      }
+    }
+  }
+  auto material1 = scene.addMaterial<Dielectric>(1.5f);
+  world.emplace_back(Point3f(0, 1, 0), 1.0f, material1);
+
+  auto material2 = scene.addMaterial<Lambertian>(Color3f(0.4, 0.2, 0.1));
+  world.emplace_back(Point3f(-4, 1, 0), 1.0f, material2);
+
+  auto material3 = scene.addMaterial<Metal>(Color3f(0.7, 0.6, 0.5), 0.0f);
+  world.emplace_back(Point3f(4, 1, 0), 1.0f, material3);
+}
+
+inline HitList toHitList(const std::vector<Sphere> &spheres) {
+  HitList world;
+  for (const auto &sphere : spheres)
+    world.add(std::make_shared<Sphere>(sphere));
+  return world;
+}
+
+// the spheres behind one SphereBVH, every mesh with its own BVH and the
+// instances behind a top level InstanceBVH. Meshes are built when loaded;
+// the build stats of everything go to log if given
+inline std::shared_ptr<Hitable> buildWorld(const Scene &scene,
+                                           std::ostream *log = nullptr) {
+  auto spheres = scene.sphereBVH
+                     ? scene.sphereBVH
+                     : std::make_shared<SphereBVH>(scene.spheres, scene.bvh);
+  if (log) {
+    spheres->buildStats.print(*log, "sphere");
+    for (const auto &mesh : scene.meshes) mesh->buildStats.print(*log, "mesh");
+  }
+  if (scene.meshes.empty() && scene.instances.empty()) return spheres;
+  auto world = std::make_shared<HitList>(spheres);
+  for (const auto &mesh : scene.meshes) world->add(mesh);
+  if (!scene.instances.empty()) {
+    auto instances =
+        std::make_shared<InstanceBVH>(scene.instances, scene.bvh);
+    if (log) instances->buildStats.print(*log, "instance");
+    world->add(instances);
+  }
+  return world;
+}
+
+// built-in scenes by name: "random" (the book's final scene), "random-big"
+// (~100k spheres) and their instanced versions "random-instanced" and
+// "instanced-huge" (~1M instances of one sphere)
+inline bool makeScene(const std::string &name, uint64_t seed, Scene &scene) {
+  scene = Scene();
+  if (name == "random") {
+    addRandomSpheres(scene, seed);
+  } else if (name == "random-big") {
+    addRandomSpheres(scene, seed, 160);
+  } else if (name == "random-instanced") {
+    addRandomSpheres(scene, seed, 11, true);
+  } else if (name == "instanced-huge") {
+    addRandomSpheres(scene, seed, 500, true);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+#endif
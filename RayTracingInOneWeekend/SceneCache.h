@@ -0,0 +1,360 @@
+#ifndef SCENE_CACHE_H_
+#define SCENE_CACHE_H_
+#include "Scene.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// binary scene cache: a header followed by flat, 64-byte aligned arrays
+// that are used in place once the file is mapped (spheres as padded SoA
+// arrays in leaf order, their BVH, mesh vertices, indices and BVHs).
+// Only materials are rebuilt on load. Data is in host byte order; bump
+// SCENE_CACHE_VERSION whenever any of the records below change
+const uint32_t SCENE_CACHE_VERSION = 1;
+const char SCENE_CACHE_MAGIC[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', 0};
+// sphere arrays are padded for the widest SIMD kernel, so a cache works
+// with any RT_SIMD setting
+const int SCENE_CACHE_PADDING = 8;
+static_assert(SCENE_CACHE_PADDING >= SphereSoA::WIDTH,
+              "scene cache padding too small for the SIMD width");
+static_assert(sizeof(Point3f) == 12, "scene cache stores Point3f as 3 floats");
+
+struct CacheArray {
+  uint64_t offset;  // from the start of the file
+  uint64_t count;
+};
+
+struct CacheBVHStats {
+  uint64_t leaves;
+  uint32_t maxDepth;
+  float sahCost;
+};
+
+struct CacheMaterial {
+  uint32_t kind;  // MaterialKind
+  float albedo[3];
+  float fuzz;
+  float refIdx;
+};
+
+struct CacheMesh {
+  uint32_t materialId;
+  uint32_t pad;
+  CacheArray positions, normals, indices, nodes;
+  CacheBVHStats stats;
+};
+
+struct SceneCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t bvhMethod;  // BVHBuildMethod
+  float camera[12];    // lookfrom, lookat, up, fov, aperture, focusDis
+  uint64_t sphereCount;
+  CacheArray materials;
+  CacheArray sphereX, sphereY, sphereZ, sphereRadius, sphereMaterial;
+  CacheArray sphereNodes;
+  CacheBVHStats sphereStats;
+  CacheArray meshes;
+};
+
+// read-only view of a whole file, mapped where the platform allows
+class MappedFile {
+ public:
+  ~MappedFile() {
+#ifndef _WIN32
+    if (base) munmap(const_cast<char *>(base), length);
+#endif
+  }
+
+  bool open(const std::string &path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      close(fd);
+      return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return false;
+    base = static_cast<const char *>(p);
+    length = st.st_size;
+#else
+    // no mapping here, read it in once instead
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) return false;
+    char buffer[1 << 16];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+      contents.insert(contents.end(), buffer, buffer + read);
+    fclose(file);
+    base = contents.data();
+    length = contents.size();
+#endif
+    return true;
+  }
+
+  const char *data() const { return base; }
+  size_t size() const { return length; }
+
+ private:
+  const char *base = nullptr;
+  size_t length = 0;
+#ifdef _WIN32
+  std::vector<char> contents;
+#endif
+};
+
+class SceneCacheWriter {
+ public:
+  // the spheres are written in the leaf order of scene.sphereBVH, which is
+  // built first if the scene has none
+  static bool write(const std::string &path, const Scene &scene) {
+    if (!scene.instances.empty()) {
+      std::cerr << "[ERROR] The scene cache does not support instances"
+                << std::endl;
+      return false;
+    }
+    SceneCacheWriter w;
+    SceneCacheHeader header = {};
+    memcpy(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic));
+    header.version = SCENE_CACHE_VERSION;
+    header.bvhMethod = static_cast<uint32_t>(scene.bvh);
+    const CameraSettings &c = scene.camera;
+    float camera[12] = {c.lookfrom.x, c.lookfrom.y, c.lookfrom.z,
+                        c.lookat.x,   c.lookat.y,   c.lookat.z,
+                        c.up.x,       c.up.y,       c.up.z,
+                        c.fov,        c.aperture,   c.focusDis};
+    memcpy(header.camera, camera, sizeof(camera));
+    w.reserve(sizeof(header));
+
+    std::vector<CacheMaterial> materials;
+    for (const auto &m : scene.materials) materials.push_back(record(*m));
+    header.materials = w.add(materials.data(), materials.size());
+
+    std::shared_ptr<const SphereBVH> world = scene.sphereBVH;
+    if (!world) world = std::make_shared<SphereBVH>(scene.spheres, scene.bvh);
+    const SphereSoA &s = world->spheres;
+    size_t padded = s.size() + SCENE_CACHE_PADDING;
+    header.sphereCount = s.size();
+    header.sphereX = w.add(padTo(s.x, padded).data(), padded);
+    header.sphereY = w.add(padTo(s.y, padded).data(), padded);
+    header.sphereZ = w.add(padTo(s.z, padded).data(), padded);
+    header.sphereRadius = w.add(padTo(s.radius, padded).data(), padded);
+    header.sphereMaterial =
+        w.add(padTo(s.materialIndex, padded).data(), padded);
+    header.sphereNodes = w.add(world->nodes.data(), world->nodes.size());
+    header.sphereStats = stats(world->buildStats);
+
+    std::vector<CacheMesh> meshes;
+    for (const auto &mesh : scene.meshes) {
+      CacheMesh m = {};
+      m.materialId = mesh->materialId;
+      m.positions = w.add(mesh->positions.data(), mesh->positions.size());
+      m.normals = w.add(mesh->normals.data(), mesh->normals.size());
+      m.indices = w.add(mesh->indices.data(), mesh->indices.size());
+      m.nodes = w.add(mesh->nodes.data(), mesh->nodes.size());
+      m.stats = stats(mesh->buildStats);
+      meshes.push_back(m);
+    }
+    header.meshes = w.add(meshes.data(), meshes.size());
+    memcpy(w.bytes.data(), &header, sizeof(header));
+
+    // written to path.tmp and renamed over path: a process that has the
+    // old cache mapped keeps reading the old file, never a truncated or
+    // half rewritten one
+    std::string tmp = path + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if (!file) {
+      std::cerr << "[ERROR] Failed to open " << tmp << std::endl;
+      return false;
+    }
+    size_t size = w.bytes.size();
+    bool ok = fwrite(w.bytes.data(), 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    if (ok) ok = rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) std::cerr << "[ERROR] Failed to write " << path << std::endl;
+    return ok;
+  }
+
+ private:
+  static CacheMaterial record(const Material &m) {
+    CacheMaterial r = {};
+    r.kind = static_cast<uint32_t>(m.kind);
+    const Color3f *albedo = nullptr;
+    if (m.kind == MaterialKind::Lambertian) {
+      albedo = &static_cast<const Lambertian &>(m).albedo;
+    } else if (m.kind == MaterialKind::Metal) {
+      albedo = &static_cast<const Metal &>(m).albedo;
+      r.fuzz = static_cast<const Metal &>(m).fuzz;
+    } else {
+      r.refIdx = static_cast<const Dielectric &>(m).refIdx;
+    }
+    if (albedo)
+      for (int a = 0; a < 3; ++a) r.albedo[a] = (*albedo)[a];
+    return r;
+  }
+
+  static CacheBVHStats stats(const BVHBuildStats &s) {
+    return CacheBVHStats{s.leaves, static_cast<uint32_t>(s.maxDepth),
+                         s.sahCost};
+  }
+
+  template <typename T>
+  static std::vector<T> padTo(const FlatArray<T> &a, size_t n) {
+    std::vector<T> v(a.begin(), a.begin() + std::min(a.size(), n));
+    v.resize(n);
+    return v;
+  }
+
+  void reserve(size_t n) { bytes.resize(n); }
+
+  template <typename T>
+  CacheArray add(const T *data, size_t count) {
+    bytes.resize((bytes.size() + 63) / 64 * 64);
+    CacheArray a{bytes.size(), count};
+    const char *p = reinterpret_cast<const char *>(data);
+    bytes.insert(bytes.end(), p, p + count * sizeof(T));
+    return a;
+  }
+
+  std::vector<char> bytes;
+};
+
+// array a of the file in place, or an empty one (clearing valid) if it
+// does not fit
+template <typename T>
+FlatArray<T> cacheView(const std::shared_ptr<MappedFile> &file,
+                       const CacheArray &a, bool &valid) {
+  if (a.offset % alignof(T) != 0 || a.offset > file->size() ||
+      a.count > (file->size() - a.offset) / sizeof(T)) {
+    valid = false;
+    return FlatArray<T>();
+  }
+  return FlatArray<T>::view(
+      reinterpret_cast<const T *>(file->data() + a.offset), a.count, file);
+}
+
+// maps a cache written by SceneCacheWriter into scene: the sphere BVH and
+// meshes point straight into the mapping, which they keep alive. Array
+// bounds, material references and the BVH nodes (small next to the
+// vertices) are checked; vertex indices are trusted so that the bulk of a
+// mesh doesn't have to be paged in up front
+inline bool loadSceneCache(const std::string &path, Scene &scene) {
+  auto file = std::make_shared<MappedFile>();
+  if (!file->open(path)) {
+    std::cerr << "[ERROR] Failed to open " << path << std::endl;
+    return false;
+  }
+  auto fail = [&](const char *what) {
+    std::cerr << "[ERROR] " << path << ": " << what << std::endl;
+    return false;
+  };
+  if (file->size() < sizeof(SceneCacheHeader)) return fail("truncated");
+  SceneCacheHeader header;
+  memcpy(&header, file->data(), sizeof(header));
+  if (memcmp(header.magic, SCENE_CACHE_MAGIC, sizeof(header.magic)) != 0)
+    return fail("not a scene cache");
+  if (header.version != SCENE_CACHE_VERSION)
+    return fail("unsupported scene cache version");
+  if (header.bvhMethod > static_cast<uint32_t>(BVHBuildMethod::LBVH))
+    return fail("unknown BVH method");
+
+  bool valid = true;
+  auto materials = cacheView<CacheMaterial>(file, header.materials, valid);
+  auto meshes = cacheView<CacheMesh>(file, header.meshes, valid);
+  size_t n = header.sphereCount;
+  auto x = cacheView<float>(file, header.sphereX, valid);
+  auto y = cacheView<float>(file, header.sphereY, valid);
+  auto z = cacheView<float>(file, header.sphereZ, valid);
+  auto radius = cacheView<float>(file, header.sphereRadius, valid);
+  auto material = cacheView<uint32_t>(file, header.sphereMaterial, valid);
+  auto nodes = cacheView<LinearBVHNode>(file, header.sphereNodes, valid);
+  if (!valid) return fail("array out of bounds");
+  // n + SCENE_CACHE_PADDING could wrap for a corrupt count
+  auto padded = [&](size_t size) {
+    return n <= size && size - n >= SCENE_CACHE_PADDING;
+  };
+  if (!padded(x.size()) || !padded(y.size()) || !padded(z.size()) ||
+      !padded(radius.size()) || !padded(material.size()))
+    return fail("bad sphere arrays");
+  if (!validLinearBVH(nodes.data(), nodes.size(), n))
+    return fail("bad sphere BVH");
+
+  scene = Scene();
+  const float *c = header.camera;
+  scene.camera.lookfrom = Point3f(c[0], c[1], c[2]);
+  scene.camera.lookat = Point3f(c[3], c[4], c[5]);
+  scene.camera.up = Vec3f(c[6], c[7], c[8]);
+  scene.camera.fov = c[9];
+  scene.camera.aperture = c[10];
+  scene.camera.focusDis = c[11];
+  scene.bvh = static_cast<BVHBuildMethod>(header.bvhMethod);
+  for (const auto &m : materials) {
+    Color3f albedo(m.albedo[0], m.albedo[1], m.albedo[2]);
+    switch (static_cast<MaterialKind>(m.kind)) {
+      case MaterialKind::Lambertian:
+        scene.addMaterial<Lambertian>(albedo);
+        break;
+      case MaterialKind::Metal:
+        scene.addMaterial<Metal>(albedo, m.fuzz);
+        break;
+      case MaterialKind::Dielectric:
+        scene.addMaterial<Dielectric>(m.refIdx);
+        break;
+      default:
+        return fail("unknown material kind");
+    }
+  }
+  // rayColor indexes the material table with these unchecked
+  for (size_t i = 0; i < n; ++i) {
+    if (material[i] >= scene.materials.size())
+      return fail("sphere material out of range");
+  }
+
+  auto cachedStats = [&](const CacheBVHStats &s, size_t primitives,
+                         size_t nodeCount) {
+    BVHBuildStats stats;
+    stats.method = scene.bvh;
+    stats.primitives = primitives;
+    stats.nodes = nodeCount;
+    stats.leaves = s.leaves;
+    stats.maxDepth = s.maxDepth;
+    stats.sahCost = s.sahCost;
+    return stats;
+  };
+  auto spheres = std::make_shared<SphereBVH>();
+  spheres->spheres.assign(n, x, y, z, radius, material);
+  spheres->buildStats = cachedStats(header.sphereStats, n, nodes.size());
+  spheres->nodes = std::move(nodes);
+  scene.sphereBVH = spheres;
+
+  for (const auto &m : meshes) {
+    if (m.materialId >= scene.materials.size())
+      return fail("mesh material out of range");
+    auto mesh = std::make_shared<TriangleMesh>();
+    mesh->materialId = m.materialId;
+    mesh->positions = cacheView<Point3f>(file, m.positions, valid);
+    mesh->normals = cacheView<Vec3f>(file, m.normals, valid);
+    mesh->indices = cacheView<uint32_t>(file, m.indices, valid);
+    mesh->nodes = cacheView<LinearBVHNode>(file, m.nodes, valid);
+    if (!valid || mesh->indices.size() % 3 != 0 ||
+        !validLinearBVH(mesh->nodes.data(), mesh->nodes.size(),
+                        mesh->triangleCount()))
+      return fail("bad mesh");
+    mesh->buildStats =
+        cachedStats(m.stats, mesh->triangleCount(), mesh->nodes.size());
+    scene.meshes.push_back(mesh);
+  }
+  return true;
+}
+
+#endif
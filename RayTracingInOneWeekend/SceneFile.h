@@ -0,0 +1,231 @@
+#ifndef SCENE_FILE_H_
+#define SCENE_FILE_H_
+#include "Scene.h"
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// text scene description, one statement per line, '#' starts a comment:
+//
+//   camera lookfrom 13 2 3 lookat 0 0 0 up 0 1 0 fov 20 aperture 0.1 focus 10
+//   bvh sah|lbvh
+//   material NAME lambertian R G B
+//   material NAME metal R G B FUZZ
+//   material NAME dielectric IOR
+//   sphere X Y Z RADIUS MATERIAL
+//   mesh PATH MATERIAL [scale S] [rotate-y DEGREES] [translate X Y Z]
+//   random [seed N] [extent N] [instanced]
+//
+// camera keys are optional and default to CameraSettings. bvh applies to
+// the whole file wherever it appears, meshes included. Mesh paths are
+// relative to the scene file; every file is loaded once, and a mesh with a
+// transform becomes an instance of it. random adds the book's random
+// spheres
+class SceneFileParser {
+ public:
+  // bvh, if given, overrides the file's own bvh statement
+  static bool load(const std::string &path, Scene &scene,
+                   const BVHBuildMethod *bvh = nullptr) {
+    std::ifstream file(path);
+    if (!file) {
+      std::cerr << "[ERROR] Failed to open " << path << std::endl;
+      return false;
+    }
+    SceneFileParser parser(path);
+    scene = Scene();
+    if (bvh) scene.bvh = *bvh;
+    parser.fixedBvh = bvh != nullptr;
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line)) {
+      size_t comment = line.find('#');
+      if (comment != std::string::npos) line.resize(comment);
+      lines.push_back(line);
+    }
+    // bvh statements first: mesh and random statements build BVHs as they
+    // are read
+    for (int pass = 0; pass < 2; ++pass) {
+      for (size_t i = 0; i < lines.size(); ++i) {
+        parser.line = static_cast<int>(i) + 1;
+        std::istringstream in(lines[i]);
+        std::string statement;
+        if (!(in >> statement) || (statement == "bvh") != (pass == 0))
+          continue;
+        if (!parser.parse(statement, in, scene)) return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  SceneFileParser(const std::string &path) : path(path) {
+    size_t slash = path.find_last_of("/\\");
+    directory = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+  }
+
+  bool error(const std::string &message) const {
+    std::cerr << "[ERROR] " << path << ":" << line << ": " << message
+              << std::endl;
+    return false;
+  }
+
+  // fails on anything left on the line
+  bool end(std::istream &in) const {
+    std::string extra;
+    if (in >> extra) return error("unexpected " + extra);
+    return true;
+  }
+
+  static bool read(std::istream &in, Vec3f &v) {
+    return static_cast<bool>(in >> v.x >> v.y >> v.z);
+  }
+
+  bool material(std::istream &in, uint32_t &id) const {
+    std::string name;
+    if (!(in >> name)) return error("missing material");
+    auto it = materials.find(name);
+    if (it == materials.end()) return error("unknown material " + name);
+    id = it->second;
+    return true;
+  }
+
+  bool parse(const std::string &statement, std::istream &in, Scene &scene) {
+    if (statement == "camera") {
+      std::string key;
+      CameraSettings &c = scene.camera;
+      while (in >> key) {
+        bool ok;
+        if (key == "lookfrom") {
+          ok = read(in, c.lookfrom);
+        } else if (key == "lookat") {
+          ok = read(in, c.lookat);
+        } else if (key == "up") {
+          ok = read(in, c.up);
+        } else if (key == "fov") {
+          ok = static_cast<bool>(in >> c.fov);
+        } else if (key == "aperture") {
+          ok = static_cast<bool>(in >> c.aperture);
+        } else if (key == "focus") {
+          ok = static_cast<bool>(in >> c.focusDis);
+        } else {
+          ok = false;
+        }
+        if (!ok) return error("bad camera setting " + key);
+      }
+    } else if (statement == "bvh") {
+      std::string method;
+      BVHBuildMethod parsed;
+      if (!(in >> method) || !parseBVHMethod(method, parsed))
+        return error("bvh must be sah or lbvh");
+      if (!end(in)) return false;
+      if (!fixedBvh) scene.bvh = parsed;
+    } else if (statement == "material") {
+      std::string name, type;
+      if (!(in >> name >> type)) return error("material needs NAME TYPE");
+      Color3f albedo;
+      float f;
+      uint32_t id;
+      if (type == "lambertian" && read(in, albedo)) {
+        id = scene.addMaterial<Lambertian>(albedo);
+      } else if (type == "metal" && read(in, albedo) && in >> f) {
+        id = scene.addMaterial<Metal>(albedo, f);
+      } else if (type == "dielectric" && in >> f) {
+        id = scene.addMaterial<Dielectric>(f);
+      } else {
+        return error("bad material " + name);
+      }
+      if (!end(in)) return false;
+      materials[name] = id;
+    } else if (statement == "sphere") {
+      Point3f center;
+      float radius;
+      uint32_t id;
+      if (!read(in, center) || !(in >> radius))
+        return error("sphere needs X Y Z RADIUS MATERIAL");
+      if (!material(in, id) || !end(in)) return false;
+      scene.spheres.emplace_back(center, radius, id);
+    } else if (statement == "mesh") {
+      return mesh(in, scene);
+    } else if (statement == "random") {
+      std::string key;
+      uint64_t seed = 0;
+      int extent = 11;
+      bool instanced = false;
+      while (in >> key) {
+        if (key == "instanced") {
+          instanced = true;
+        } else if (!(key == "seed" && in >> seed) &&
+                   !(key == "extent" && in >> extent)) {
+          return error("bad random setting " + key);
+        }
+      }
+      addRandomSpheres(scene, seed, extent, instanced);
+    } else {
+      return error("unknown statement " + statement);
+    }
+    return true;
+  }
+
+  bool mesh(std::istream &in, Scene &scene) {
+    std::string file, key;
+    uint32_t id;
+    if (!(in >> file)) return error("mesh needs PATH MATERIAL");
+    if (!material(in, id)) return false;
+    Transform transform;
+    bool transformed = false;
+    while (in >> key) {
+      float s;
+      Vec3f d;
+      if (key == "scale" && in >> s) {
+        transform = Transform::scale(s) * transform;
+      } else if (key == "rotate-y" && in >> s) {
+        transform = Transform::rotateY(s) * transform;
+      } else if (key == "translate" && read(in, d)) {
+        transform = Transform::translate(d) * transform;
+      } else {
+        return error("bad mesh setting " + key);
+      }
+      transformed = true;
+    }
+    std::string fullPath = directory + file;
+    auto &shared = meshes[fullPath];
+    if (!shared) {
+      shared = std::make_shared<TriangleMesh>();
+      if (!loadObj(fullPath, id, *shared, scene.bvh))
+        return error("failed to load mesh " + file);
+    }
+    if (transformed) {
+      // the instance supplies the material
+      scene.instances.emplace_back(shared, transform, id);
+    } else if (shared->materialId == id) {
+      scene.meshes.push_back(shared);
+    } else {
+      auto mesh = std::make_shared<TriangleMesh>(*shared);
+      mesh->materialId = id;
+      scene.meshes.push_back(mesh);
+    }
+    return true;
+  }
+
+  std::string path, directory;
+  int line = 0;
+  bool fixedBvh = false;
+  std::map<std::string, uint32_t> materials;
+  std::map<std::string, std::shared_ptr<TriangleMesh> > meshes;
+};
+
+// a built-in scene by name (see makeScene) or else a scene file; bvh, if
+// given, overrides the scene's build method
+inline bool loadScene(const std::string &nameOrPath, uint64_t seed,
+                      Scene &scene, const BVHBuildMethod *bvh = nullptr) {
+  if (makeScene(nameOrPath, seed, scene)) {
+    if (bvh) scene.bvh = *bvh;
+    return true;
+  }
+  return SceneFileParser::load(nameOrPath, scene, bvh);
+}
+
+#endif
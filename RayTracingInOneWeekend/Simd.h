@@ -0,0 +1,254 @@
+#ifndef SIMD_H_
+#define SIMD_H_
+#include "Math.h"
+#include <cmath>
+#include <cstdint>
+
+// wide math for packet and SoA kernels, written once against FloatN /
+// IntN / MaskN / Vec3N and compiled to the backend chosen at build time:
+// 8 lanes with AVX2 + FMA (Vec3N is then a "Vec3x8"), 4 with SSE2, or a
+// single plain float. RT_SIMD_SCALAR forces the scalar backend, otherwise
+// the widest instruction set enabled for the compiler is used. Vec3f
+// itself stays 3 packed floats: it is the storage format of scene caches,
+// checkpoints and GL buffers. MSVC never defines __FMA__, but /arch:AVX2
+// enables FMA code generation along with AVX2
+#if !defined(RT_SIMD_SCALAR) && defined(__AVX2__) && \
+    (defined(__FMA__) || defined(_MSC_VER))
+#define RT_SIMD_AVX2
+#include <immintrin.h>
+#elif !defined(RT_SIMD_SCALAR) &&                                 \
+    (defined(__SSE2__) || defined(_M_X64) ||                      \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define RT_SIMD_SSE
+#include <emmintrin.h>
+#endif
+
+#if defined(RT_SIMD_AVX2)
+
+struct FloatN {
+  static const int WIDTH = 8;
+  FloatN() = default;
+  FloatN(__m256 v) : v(v) {}
+  explicit FloatN(float f) : v(_mm256_set1_ps(f)) {}
+  static FloatN load(const float *p) { return _mm256_loadu_ps(p); }
+  void store(float *p) const { _mm256_storeu_ps(p, v); }
+  __m256 v;
+};
+
+struct IntN {
+  IntN() = default;
+  IntN(__m256i v) : v(v) {}
+  explicit IntN(int i) : v(_mm256_set1_epi32(i)) {}
+  // first, first + 1, ...
+  static IntN iota(int first) {
+    return _mm256_add_epi32(_mm256_set1_epi32(first),
+                            _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+  }
+  void store(int *p) const {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), v);
+  }
+  __m256i v;
+};
+
+struct MaskN {
+  MaskN() = default;
+  MaskN(__m256 m) : m(m) {}
+  __m256 m;
+};
+
+inline FloatN operator+(FloatN a, FloatN b) { return _mm256_add_ps(a.v, b.v); }
+inline FloatN operator-(FloatN a, FloatN b) { return _mm256_sub_ps(a.v, b.v); }
+inline FloatN operator*(FloatN a, FloatN b) { return _mm256_mul_ps(a.v, b.v); }
+inline FloatN operator/(FloatN a, FloatN b) { return _mm256_div_ps(a.v, b.v); }
+inline FloatN operator-(FloatN a) {
+  return _mm256_sub_ps(_mm256_setzero_ps(), a.v);
+}
+// a * b + c, a * b - c and c - a * b with a single rounding
+inline FloatN fmadd(FloatN a, FloatN b, FloatN c) {
+  return _mm256_fmadd_ps(a.v, b.v, c.v);
+}
+inline FloatN fmsub(FloatN a, FloatN b, FloatN c) {
+  return _mm256_fmsub_ps(a.v, b.v, c.v);
+}
+inline FloatN fnmadd(FloatN a, FloatN b, FloatN c) {
+  return _mm256_fnmadd_ps(a.v, b.v, c.v);
+}
+inline FloatN sqrt(FloatN a) { return _mm256_sqrt_ps(a.v); }
+inline FloatN min(FloatN a, FloatN b) { return _mm256_min_ps(a.v, b.v); }
+inline FloatN max(FloatN a, FloatN b) { return _mm256_max_ps(a.v, b.v); }
+
+inline MaskN operator<(FloatN a, FloatN b) {
+  return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ);
+}
+inline MaskN operator>(FloatN a, FloatN b) {
+  return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ);
+}
+inline MaskN operator>(IntN a, IntN b) {
+  return _mm256_castsi256_ps(_mm256_cmpgt_epi32(a.v, b.v));
+}
+inline MaskN operator&(MaskN a, MaskN b) { return _mm256_and_ps(a.m, b.m); }
+inline MaskN operator|(MaskN a, MaskN b) { return _mm256_or_ps(a.m, b.m); }
+// bit i set if lane i is
+inline unsigned bits(MaskN a) { return _mm256_movemask_ps(a.m); }
+
+inline IntN operator+(IntN a, IntN b) { return _mm256_add_epi32(a.v, b.v); }
+
+// mask ? a : b per lane
+inline FloatN select(MaskN mask, FloatN a, FloatN b) {
+  return _mm256_blendv_ps(b.v, a.v, mask.m);
+}
+inline IntN select(MaskN mask, IntN a, IntN b) {
+  return _mm256_castps_si256(_mm256_blendv_ps(
+      _mm256_castsi256_ps(b.v), _mm256_castsi256_ps(a.v), mask.m));
+}
+
+#elif defined(RT_SIMD_SSE)
+
+struct FloatN {
+  static const int WIDTH = 4;
+  FloatN() = default;
+  FloatN(__m128 v) : v(v) {}
+  explicit FloatN(float f) : v(_mm_set1_ps(f)) {}
+  static FloatN load(const float *p) { return _mm_loadu_ps(p); }
+  void store(float *p) const { _mm_storeu_ps(p, v); }
+  __m128 v;
+};
+
+struct IntN {
+  IntN() = default;
+  IntN(__m128i v) : v(v) {}
+  explicit IntN(int i) : v(_mm_set1_epi32(i)) {}
+  static IntN iota(int first) {
+    return _mm_add_epi32(_mm_set1_epi32(first), _mm_setr_epi32(0, 1, 2, 3));
+  }
+  void store(int *p) const {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+  }
+  __m128i v;
+};
+
+struct MaskN {
+  MaskN() = default;
+  MaskN(__m128 m) : m(m) {}
+  __m128 m;
+};
+
+inline FloatN operator+(FloatN a, FloatN b) { return _mm_add_ps(a.v, b.v); }
+inline FloatN operator-(FloatN a, FloatN b) { return _mm_sub_ps(a.v, b.v); }
+inline FloatN operator*(FloatN a, FloatN b) { return _mm_mul_ps(a.v, b.v); }
+inline FloatN operator/(FloatN a, FloatN b) { return _mm_div_ps(a.v, b.v); }
+inline FloatN operator-(FloatN a) { return _mm_sub_ps(_mm_setzero_ps(), a.v); }
+// no FMA here: two roundings
+inline FloatN fmadd(FloatN a, FloatN b, FloatN c) { return a * b + c; }
+inline FloatN fmsub(FloatN a, FloatN b, FloatN c) { return a * b - c; }
+inline FloatN fnmadd(FloatN a, FloatN b, FloatN c) { return c - a * b; }
+inline FloatN sqrt(FloatN a) { return _mm_sqrt_ps(a.v); }
+inline FloatN min(FloatN a, FloatN b) { return _mm_min_ps(a.v, b.v); }
+inline FloatN max(FloatN a, FloatN b) { return _mm_max_ps(a.v, b.v); }
+
+inline MaskN operator<(FloatN a, FloatN b) { return _mm_cmplt_ps(a.v, b.v); }
+inline MaskN operator>(FloatN a, FloatN b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline MaskN operator>(IntN a, IntN b) {
+  return _mm_castsi128_ps(_mm_cmpgt_epi32(a.v, b.v));
+}
+inline MaskN operator&(MaskN a, MaskN b) { return _mm_and_ps(a.m, b.m); }
+inline MaskN operator|(MaskN a, MaskN b) { return _mm_or_ps(a.m, b.m); }
+inline unsigned bits(MaskN a) { return _mm_movemask_ps(a.m); }
+
+inline IntN operator+(IntN a, IntN b) { return _mm_add_epi32(a.v, b.v); }
+
+// SSE2 has no blend
+inline FloatN select(MaskN mask, FloatN a, FloatN b) {
+  return _mm_or_ps(_mm_and_ps(mask.m, a.v), _mm_andnot_ps(mask.m, b.v));
+}
+inline IntN select(MaskN mask, IntN a, IntN b) {
+  return _mm_castps_si128(select(mask, FloatN(_mm_castsi128_ps(a.v)),
+                                 FloatN(_mm_castsi128_ps(b.v)))
+                              .v);
+}
+
+#else
+
+struct FloatN {
+  static const int WIDTH = 1;
+  FloatN() = default;
+  explicit FloatN(float f) : v(f) {}
+  static FloatN load(const float *p) { return FloatN(*p); }
+  void store(float *p) const { *p = v; }
+  float v;
+};
+
+struct IntN {
+  IntN() = default;
+  explicit IntN(int i) : v(i) {}
+  static IntN iota(int first) { return IntN(first); }
+  void store(int *p) const { *p = v; }
+  int v;
+};
+
+struct MaskN {
+  MaskN() = default;
+  MaskN(bool m) : m(m) {}
+  bool m;
+};
+
+inline FloatN operator+(FloatN a, FloatN b) { return FloatN(a.v + b.v); }
+inline FloatN operator-(FloatN a, FloatN b) { return FloatN(a.v - b.v); }
+inline FloatN operator*(FloatN a, FloatN b) { return FloatN(a.v * b.v); }
+inline FloatN operator/(FloatN a, FloatN b) { return FloatN(a.v / b.v); }
+inline FloatN operator-(FloatN a) { return FloatN(-a.v); }
+inline FloatN fmadd(FloatN a, FloatN b, FloatN c) { return a * b + c; }
+inline FloatN fmsub(FloatN a, FloatN b, FloatN c) { return a * b - c; }
+inline FloatN fnmadd(FloatN a, FloatN b, FloatN c) { return c - a * b; }
+inline FloatN sqrt(FloatN a) { return FloatN(std::sqrt(a.v)); }
+inline FloatN min(FloatN a, FloatN b) { return FloatN(a.v < b.v ? a.v : b.v); }
+inline FloatN max(FloatN a, FloatN b) { return FloatN(a.v > b.v ? a.v : b.v); }
+
+inline MaskN operator<(FloatN a, FloatN b) { return a.v < b.v; }
+inline MaskN operator>(FloatN a, FloatN b) { return a.v > b.v; }
+inline MaskN operator>(IntN a, IntN b) { return a.v > b.v; }
+inline MaskN operator&(MaskN a, MaskN b) { return a.m && b.m; }
+inline MaskN operator|(MaskN a, MaskN b) { return a.m || b.m; }
+inline unsigned bits(MaskN a) { return a.m ? 1 : 0; }
+
+inline IntN operator+(IntN a, IntN b) { return IntN(a.v + b.v); }
+
+inline FloatN select(MaskN mask, FloatN a, FloatN b) {
+  return mask.m ? a : b;
+}
+inline IntN select(MaskN mask, IntN a, IntN b) { return mask.m ? a : b; }
+
+#endif
+
+// FloatN::WIDTH vectors, one per lane, as three coordinate registers
+struct Vec3N {
+  Vec3N() = default;
+  Vec3N(FloatN x, FloatN y, FloatN z) : x(x), y(y), z(z) {}
+  // v in every lane
+  explicit Vec3N(const Vec3f &v) : x(v.x), y(v.y), z(v.z) {}
+
+  // lanes i, i + 1, ... of SoA coordinate arrays
+  static Vec3N load(const float *xs, const float *ys, const float *zs,
+                    size_t i) {
+    return Vec3N(FloatN::load(xs + i), FloatN::load(ys + i),
+                 FloatN::load(zs + i));
+  }
+
+  FloatN x, y, z;
+};
+
+inline Vec3N operator+(const Vec3N &a, const Vec3N &b) {
+  return Vec3N(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+inline Vec3N operator-(const Vec3N &a, const Vec3N &b) {
+  return Vec3N(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+inline FloatN dot(const Vec3N &a, const Vec3N &b) {
+  return fmadd(a.x, b.x, fmadd(a.y, b.y, a.z * b.z));
+}
+
+#if defined(RT_SIMD_AVX2)
+using Vec3x8 = Vec3N;
+#endif
+
+#endif
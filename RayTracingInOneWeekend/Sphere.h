@@ -4,42 +4,48 @@
 
 struct Sphere : public Hitable {
   Sphere() = default;
-  Sphere(const Point3f &center, float r, std::shared_ptr<Material> material)
-      : center(center), radius(r), material(material) {}
+  Sphere(const Point3f &center, float r, uint32_t materialId)
+      : center(center), radius(r), materialId(materialId) {}
 
-  bool hit(const Ray &r, float tMin, float tMax,
-           HitRecord &rec) const override {
+  bool intersect(const Ray &r, float tMin, float tMax,
+                 Intersection &isect) const override {
     Vec3f oc = r.origin - center;
     auto a = r.dir.norm2();
     auto halfB = dot(oc, r.dir);
     auto c = oc.norm2() - radius * radius;
     auto delta = halfB * halfB - a * c;
     if (delta > 0) {
-      delta = sqrt(delta);
+      delta = std::sqrt(delta);
       auto tmp = (-halfB - delta) / a;
+      if (!(tmp < tMax && tmp > tMin)) tmp = (-halfB + delta) / a;
       if (tmp < tMax && tmp > tMin) {
-        rec.t = tmp;
-        rec.p = r.at(rec.t);
-        Vec3f outward = (rec.p - center) / radius;
-        rec.setFaceNormal(r, outward);
-        rec.material = material;
-        return true;
-      }
-      tmp = (-halfB + delta) / a;
-      if (tmp < tMax && tmp > tMin) {
-        rec.t = tmp;
-        rec.p = r.at(rec.t);
-        Vec3f outward = (rec.p - center) / radius;
-        rec.setFaceNormal(r, outward);
-        rec.material = material;
+        isect.t = tmp;
+        isect.primId = 0;
+        isect.object = this;
+        isect.instance = nullptr;
         return true;
       }
     }
     return false;
   }
 
+  void surface(const Ray &r, const Intersection &isect,
+               HitRecord &rec) const override {
+    rec.t = isect.t;
+    rec.p = r.at(rec.t);
+    Vec3f outward = (rec.p - center) / radius;
+    rec.setFaceNormal(r, outward);
+    rec.materialId = materialId;
+  }
+
+  bool boundingBox(AABB &box) const override {
+    Vec3f r(radius, radius, radius);
+    box = AABB(center - r, center + r);
+    return true;
+  }
+
   Point3f center;
   float radius;
-  std::shared_ptr<Material> material;
+  uint32_t materialId;
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,160 @@
+#ifndef SPHERE_BVH_H_
+#define SPHERE_BVH_H_
+#include "SphereSoA.h"
+#include "LinearBVH.h"
+
+// a bundle of coherent rays, e.g. the samples of one pixel; one ray per
+// SIMD lane
+struct RayPacket {
+  static const int SIZE = FloatN::WIDTH;
+
+  Ray rays[SIZE];
+  int size = 0;
+};
+
+// the rays of a packet against one node at a time, a lane per ray; the
+// same slab test as RayBoxTest, so every lane agrees with it exactly
+struct PacketBoxTest {
+  explicit PacketBoxTest(const RayPacket &packet) {
+    float o[3][RayPacket::SIZE] = {}, inv[3][RayPacket::SIZE] = {};
+    for (int i = 0; i < packet.size; ++i) {
+      for (int a = 0; a < 3; ++a) {
+        o[a][i] = packet.rays[i].origin[a];
+        inv[a][i] = 1.0f / packet.rays[i].dir[a];
+      }
+    }
+    origin = Vec3N::load(o[0], o[1], o[2], 0);
+    invDir = Vec3N::load(inv[0], inv[1], inv[2], 0);
+    for (int a = 0; a < 3; ++a)
+      dirIsNeg[a] = FloatN::load(inv[a]) < FloatN(0.0f);
+    lanes = (1u << packet.size) - 1;
+  }
+
+  // bit i set if ray i's interval (tMin, tMax[i]) reaches the node
+  unsigned hit(const LinearBVHNode &node, float tMin,
+               const float *tMax) const {
+    FloatN near(tMin), far = FloatN::load(tMax);
+    const FloatN *o = &origin.x, *inv = &invDir.x;
+    for (int a = 0; a < 3; ++a) {
+      FloatN lo(node.bounds[0][a]), hi(node.bounds[1][a]);
+      FloatN t0 = (select(dirIsNeg[a], hi, lo) - o[a]) * inv[a];
+      FloatN t1 = (select(dirIsNeg[a], lo, hi) - o[a]) * inv[a];
+      near = max(t0, near);
+      far = min(t1, far);
+    }
+    return ~bits(far < near) & lanes;
+  }
+
+  Vec3N origin, invDir;
+  MaskN dirIsNeg[3];
+  unsigned lanes;
+};
+
+// spheres stored by value in leaf order behind a flattened BVH; leaves
+// hold up to two SIMD groups that are tested in one kernel call
+struct SphereBVH : public Hitable {
+  SphereBVH() = default;
+  SphereBVH(const std::vector<Sphere> &prims,
+            BVHBuildMethod method = BVHBuildMethod::SAH) {
+    std::vector<AABB> bounds(prims.size());
+    for (size_t i = 0; i < prims.size(); ++i) prims[i].boundingBox(bounds[i]);
+    std::vector<LinearBVHNode> tree;
+    std::vector<uint32_t> order;
+    buildStats = LinearBVHBuilder::build(bounds, tree, order,
+                                         std::max(4, 2 * SphereSoA::WIDTH),
+                                         SphereSoA::WIDTH, method);
+    nodes = std::move(tree);
+    for (auto i : order) spheres.add(prims[i]);
+  }
+
+  bool intersect(const Ray &r, float tMin, float tMax,
+                 Intersection &isect) const override {
+    if (nodes.empty()) return false;
+    int closest = -1;
+    float tHit = tMax;
+    traverseLinearBVH(nodes.data(), r, tMin, tMax,
+                      [&](int offset, int count, float &tMax) {
+                        int i = spheres.closestHit(r, offset, offset + count,
+                                                   tMin, tMax);
+                        if (i < 0) return false;
+                        closest = i;
+                        tHit = tMax;
+                        return true;
+                      });
+    if (closest < 0) return false;
+    isect.t = tHit;
+    isect.primId = static_cast<uint32_t>(closest);
+    isect.object = this;
+    isect.instance = nullptr;
+    return true;
+  }
+
+  void surface(const Ray &r, const Intersection &isect,
+               HitRecord &rec) const override {
+    spheres.surface(r, isect.primId, isect.t, rec);
+  }
+
+  // traces the packet together: every node is fetched once and tested
+  // against all rays whose current interval still reaches it
+  void hitPacket(const RayPacket &packet, float tMin, float tMax,
+                 HitRecord *recs, bool *hits) const {
+    float closest[RayPacket::SIZE];
+    int prim[RayPacket::SIZE];
+    for (int i = 0; i < RayPacket::SIZE; ++i) {
+      closest[i] = tMax;
+      prim[i] = -1;
+    }
+    if (nodes.empty() || packet.size == 0) {
+      for (int i = 0; i < packet.size; ++i) hits[i] = false;
+      return;
+    }
+    PacketBoxTest test(packet);
+    // children are visited in the order of the first ray
+    RayBoxTest first(packet.rays[0]);
+    int stack[LINEAR_BVH_STACK];
+    int stackSize = 0;
+    int current = 0;
+    for (;;) {
+      const LinearBVHNode &node = nodes[current];
+      unsigned active = test.hit(node, tMin, closest);
+      if (active && node.nPrimitives == 0) {
+        if (first.dirIsNeg[node.axis]) {
+          stack[stackSize++] = current + 1;
+          current = node.secondChildOffset;
+        } else {
+          stack[stackSize++] = node.secondChildOffset;
+          current = current + 1;
+        }
+        continue;
+      }
+      if (active) {
+        int end = node.primitivesOffset + node.nPrimitives;
+        for (int i = 0; i < packet.size; ++i) {
+          if (!(active >> i & 1)) continue;
+          int p = spheres.closestHit(packet.rays[i], node.primitivesOffset,
+                                     end, tMin, closest[i]);
+          if (p >= 0) prim[i] = p;
+        }
+      }
+      if (stackSize == 0) break;
+      current = stack[--stackSize];
+    }
+    for (int i = 0; i < packet.size; ++i) {
+      hits[i] = prim[i] >= 0;
+      if (hits[i])
+        spheres.surface(packet.rays[i], prim[i], closest[i], recs[i]);
+    }
+  }
+
+  bool boundingBox(AABB &box) const override {
+    if (nodes.empty()) return false;
+    box = nodes[0].box();
+    return true;
+  }
+
+  FlatArray<LinearBVHNode> nodes;
+  SphereSoA spheres;
+  BVHBuildStats buildStats;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef SPHERE_SOA_H_
+#define SPHERE_SOA_H_
+#include "Sphere.h"
+#include "FlatArray.h"
+#include "Simd.h"
+#include <cstdint>
+#include <limits>
+
+// spheres as separate coordinate arrays so one instruction tests a whole
+// group of them against a ray
+struct SphereSoA {
+  static const int WIDTH = FloatN::WIDTH;
+
+  size_t size() const { return count; }
+
+  void add(const Sphere &s) {
+    // keep WIDTH spare elements so a vector load from any valid index stays
+    // inside the arrays
+    size_t n = count++;
+    x.resize(count + WIDTH);
+    y.resize(count + WIDTH);
+    z.resize(count + WIDTH);
+    radius.resize(count + WIDTH);
+    materialIndex.resize(count + WIDTH);
+    x[n] = s.center.x;
+    y[n] = s.center.y;
+    z[n] = s.center.z;
+    radius[n] = s.radius;
+    materialIndex[n] = s.materialId;
+  }
+
+  // nearest sphere in [begin, end) hit within (tMin, tMax), or -1;
+  // tMax is narrowed to the hit distance
+  int closestHit(const Ray &r, size_t begin, size_t end, float tMin,
+                 float &tMax) const {
+    const Vec3N origin(r.origin), dir(r.dir);
+    const FloatN a(r.dir.norm2());
+    const FloatN invA = FloatN(1.0f) / a;
+    const FloatN zero(0.0f), vMin(tMin);
+    const FloatN inf(std::numeric_limits<float>::infinity());
+    const IntN step(WIDTH), last(static_cast<int>(end));
+    FloatN best = inf, vMax(tMax);
+    IntN bestIndex(-1), index = IntN::iota(static_cast<int>(begin));
+    for (size_t i = begin; i < end; i += WIDTH) {
+      Vec3N oc = origin - Vec3N::load(&x[0], &y[0], &z[0], i);
+      FloatN rad = FloatN::load(&radius[i]);
+      FloatN halfB = dot(oc, dir);
+      // |oc|^2 - r^2
+      FloatN c = fmsub(oc.x, oc.x,
+                       fnmadd(oc.y, oc.y, fnmadd(oc.z, oc.z, rad * rad)));
+      FloatN delta = fmsub(halfB, halfB, a * c);
+      MaskN valid = (delta > zero) & (last > index);
+      FloatN sq = sqrt(delta);
+      FloatN t0 = (-halfB - sq) * invA;
+      FloatN t1 = (sq - halfB) * invA;
+      MaskN in0 = (t0 < vMax) & (t0 > vMin);
+      MaskN in1 = (t1 < vMax) & (t1 > vMin);
+      FloatN t = select(in0, t0, select(in1, t1, inf));
+      MaskN closer = valid & (t < best);
+      best = select(closer, t, best);
+      bestIndex = select(closer, index, bestIndex);
+      index = index + step;
+    }
+    float ts[WIDTH];
+    int ids[WIDTH];
+    best.store(ts);
+    bestIndex.store(ids);
+    return reduce(ts, ids, tMax);
+  }
+
+  // fills the surface data of sphere i at distance t
+  void surface(const Ray &r, int i, float t, HitRecord &rec) const {
+    Point3f center(x[i], y[i], z[i]);
+    rec.t = t;
+    rec.p = r.at(t);
+    Vec3f outward = (rec.p - center) / radius[i];
+    rec.setFaceNormal(r, outward);
+    rec.materialId = materialIndex[i];
+  }
+
+  Sphere sphere(int i) const {
+    return Sphere(Point3f(x[i], y[i], z[i]), radius[i], materialIndex[i]);
+  }
+
+  // takes over arrays of n spheres padded with WIDTH spare elements
+  void assign(size_t n, FlatArray<float> x, FlatArray<float> y,
+              FlatArray<float> z, FlatArray<float> radius,
+              FlatArray<uint32_t> materialIndex) {
+    count = n;
+    this->x = std::move(x);
+    this->y = std::move(y);
+    this->z = std::move(z);
+    this->radius = std::move(radius);
+    this->materialIndex = std::move(materialIndex);
+  }
+
+  FlatArray<float> x, y, z, radius;
+  FlatArray<uint32_t> materialIndex;
+
+ private:
+  static int reduce(const float *ts, const int *ids, float &tMax) {
+    int closest = -1;
+    float t = tMax;
+    for (int k = 0; k < WIDTH; ++k) {
+      if (ids[k] < 0) continue;
+      if (ts[k] < t || (ts[k] == t && closest >= 0 && ids[k] < closest)) {
+        t = ts[k];
+        closest = ids[k];
+      }
+    }
+    if (closest >= 0) tMax = t;
+    return closest;
+  }
+
+  size_t count = 0;
+};
+
+#endif
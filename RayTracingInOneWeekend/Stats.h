@@ -0,0 +1,151 @@
+#ifndef STATS_H_
+#define STATS_H_
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// hot path counters. Built with RT_ENABLE_STATS, the renderer points each
+// render thread at its own RenderCounters (no sharing, no atomics) and sums
+// them once the render is done; without it RT_COUNT expands to nothing and
+// the counters stay zero. Only the tile renderer attributes counters, work
+// done by other renderers' threads is not counted
+struct RenderCounters {
+  static const int DEPTHS = 16;
+  long long samples = 0;
+  long long rays[DEPTHS] = {};  // traced at each depth, the last bin is open
+  long long hits = 0, misses = 0;
+  long long nodeVisits = 0;      // BVH nodes whose box was tested
+  long long leafPrimitives = 0;  // primitives in the leaves reached
+  long long listTests = 0;       // objects tested by HitLists
+  long long scatters[3] = {};    // Material::scatter calls by MaterialKind
+  long long absorbed = 0;        // scatters that ended the path
+  long long rouletteKills = 0;
+  double busySeconds = 0;
+
+  long long totalRays() const {
+    long long n = 0;
+    for (long long r : rays) n += r;
+    return n;
+  }
+
+  void add(const RenderCounters &o) {
+    samples += o.samples;
+    for (int d = 0; d < DEPTHS; ++d) rays[d] += o.rays[d];
+    hits += o.hits;
+    misses += o.misses;
+    nodeVisits += o.nodeVisits;
+    leafPrimitives += o.leafPrimitives;
+    listTests += o.listTests;
+    for (int k = 0; k < 3; ++k) scatters[k] += o.scatters[k];
+    absorbed += o.absorbed;
+    rouletteKills += o.rouletteKills;
+    busySeconds += o.busySeconds;
+  }
+};
+
+#ifdef RT_ENABLE_STATS
+const bool STATS_ENABLED = true;
+#else
+const bool STATS_ENABLED = false;
+#endif
+
+// the counters of the calling thread, null outside a counted render
+inline RenderCounters *&activeCounters() {
+  thread_local RenderCounters *counters = nullptr;
+  return counters;
+}
+
+// makes counters the calling thread's for the scope's lifetime
+class CounterScope {
+ public:
+  explicit CounterScope(RenderCounters &counters)
+      : previous(activeCounters()) {
+    activeCounters() = &counters;
+  }
+  ~CounterScope() { activeCounters() = previous; }
+
+ private:
+  RenderCounters *previous;
+};
+
+// RT_COUNT(hits++), RT_COUNT(leafPrimitives += n)
+#ifdef RT_ENABLE_STATS
+#define RT_COUNT(update)                                   \
+  do {                                                     \
+    if (RenderCounters *counters_ = activeCounters()) {    \
+      counters_->update;                                   \
+    }                                                      \
+  } while (0)
+#else
+#define RT_COUNT(update) \
+  do {                   \
+  } while (0)
+#endif
+
+// totals plus one line per render thread
+inline void printCounters(std::ostream &os,
+                          const std::vector<RenderCounters> &threads) {
+  RenderCounters t;
+  for (const auto &c : threads) t.add(c);
+  long long rays = std::max(t.totalRays(), 1LL);
+  os << std::fixed << std::setprecision(3);
+  os << "render counters\n"
+     << "  samples              " << t.samples << "\n"
+     << "  rays                 " << t.totalRays() << " ("
+     << static_cast<double>(t.totalRays()) / std::max(t.samples, 1LL)
+     << " per sample)\n"
+     << "  rays by depth       ";
+  int last = RenderCounters::DEPTHS - 1;
+  while (last > 0 && t.rays[last] == 0) --last;
+  for (int d = 0; d <= last; ++d) os << " " << t.rays[d];
+  os << "\n"
+     << "  hits / misses        " << t.hits << " / " << t.misses << " ("
+     << 100.0 * t.hits / rays << "% hit)\n"
+     << "  BVH nodes per ray    " << static_cast<double>(t.nodeVisits) / rays
+     << "\n"
+     << "  leaf prims per ray   "
+     << static_cast<double>(t.leafPrimitives) / rays << "\n"
+     << "  list tests per ray   " << static_cast<double>(t.listTests) / rays
+     << "\n"
+     << "  scatters             lambertian " << t.scatters[0] << ", metal "
+     << t.scatters[1] << ", dielectric " << t.scatters[2] << "\n"
+     << "  absorbed             " << t.absorbed << "\n"
+     << "  roulette kills       " << t.rouletteKills << "\n";
+  for (size_t i = 0; i < threads.size(); ++i) {
+    const RenderCounters &c = threads[i];
+    os << "  thread " << i << ": busy " << c.busySeconds << "s, "
+       << c.samples << " samples, " << c.totalRays() << " rays\n";
+  }
+  os << std::defaultfloat;
+  os.flush();
+}
+
+// the same as a JSON object
+inline void writeCountersJson(std::ostream &os,
+                              const std::vector<RenderCounters> &threads) {
+  RenderCounters t;
+  for (const auto &c : threads) t.add(c);
+  os << "{\"samples\": " << t.samples << ", \"rays\": " << t.totalRays()
+     << ", \"rays_by_depth\": [";
+  for (int d = 0; d < RenderCounters::DEPTHS; ++d)
+    os << (d ? ", " : "") << t.rays[d];
+  os << "], \"hits\": " << t.hits << ", \"misses\": " << t.misses
+     << ", \"node_visits\": " << t.nodeVisits
+     << ", \"leaf_primitives\": " << t.leafPrimitives
+     << ", \"list_tests\": " << t.listTests
+     << ", \"scatters\": {\"lambertian\": " << t.scatters[0]
+     << ", \"metal\": " << t.scatters[1]
+     << ", \"dielectric\": " << t.scatters[2] << "}"
+     << ", \"absorbed\": " << t.absorbed
+     << ", \"roulette_kills\": " << t.rouletteKills << ", \"threads\": [";
+  for (size_t i = 0; i < threads.size(); ++i) {
+    const RenderCounters &c = threads[i];
+    os << (i ? ", " : "") << "{\"busy_seconds\": " << c.busySeconds
+       << ", \"samples\": " << c.samples << ", \"rays\": " << c.totalRays()
+       << "}";
+  }
+  os << "]}";
+}
+
+#endif
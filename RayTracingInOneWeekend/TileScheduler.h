@@ -0,0 +1,159 @@
+#ifndef TILE_SCHEDULER_H_
+#define TILE_SCHEDULER_H_
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Tile {
+  int x0, y0;  // inclusive
+  int x1, y1;  // exclusive
+};
+
+struct TileStats {
+  Tile tile;
+  int thread;
+  double seconds;
+};
+
+// splits the image into tiles in Morton order and renders them on a pool of
+// threads; each thread owns a deque of neighbouring tiles and steals from
+// the far end of the others' deques once its own runs dry
+class TileScheduler {
+ public:
+  TileScheduler(int width, int height, int tileSize = 32, int threads = 0)
+      : threads(threads > 0 ? threads : defaultThreads()) {
+    int nx = (width + tileSize - 1) / tileSize;
+    int ny = (height + tileSize - 1) / tileSize;
+    std::vector<std::pair<uint64_t, Tile> > order;
+    for (int ty = 0; ty < ny; ++ty) {
+      for (int tx = 0; tx < nx; ++tx) {
+        Tile t{tx * tileSize, ty * tileSize,
+               std::min(width, (tx + 1) * tileSize),
+               std::min(height, (ty + 1) * tileSize)};
+        order.emplace_back(morton(tx, ty), t);
+      }
+    }
+    std::sort(order.begin(), order.end(),
+              [](const std::pair<uint64_t, Tile> &a,
+                 const std::pair<uint64_t, Tile> &b) {
+                return a.first < b.first;
+              });
+    for (const auto &p : order) tiles.push_back(p.second);
+  }
+
+  int threadCount() const { return threads; }
+  const std::vector<Tile> &getTiles() const { return tiles; }
+  const std::vector<TileStats> &getStats() const { return stats; }
+
+  // calls fn(tile, thread) exactly once for every tile, returns when all
+  // tiles are done
+  void run(const std::function<void(const Tile &, int)> &fn) {
+    std::vector<WorkQueue> queues(threads);
+    size_t n = tiles.size();
+    for (int t = 0; t < threads; ++t) {
+      size_t begin = n * t / threads, end = n * (t + 1) / threads;
+      for (size_t i = begin; i < end; ++i) queues[t].tiles.push_back(i);
+    }
+    stats.assign(n, TileStats());
+    busy.assign(threads, 0);
+    steals.assign(threads, 0);
+
+    auto worker = [&](int self) {
+      for (;;) {
+        int tile = -1;
+        {
+          std::lock_guard<std::mutex> lock(queues[self].mutex);
+          if (!queues[self].tiles.empty()) {
+            tile = queues[self].tiles.front();
+            queues[self].tiles.pop_front();
+          }
+        }
+        for (int k = 1; tile < 0 && k < threads; ++k) {
+          WorkQueue &victim = queues[(self + k) % threads];
+          std::lock_guard<std::mutex> lock(victim.mutex);
+          if (!victim.tiles.empty()) {
+            tile = victim.tiles.back();
+            victim.tiles.pop_back();
+            ++steals[self];
+          }
+        }
+        // tiles are never re-queued, so empty queues everywhere means done
+        if (tile < 0) return;
+        auto start = std::chrono::high_resolution_clock::now();
+        fn(tiles[tile], self);
+        auto end = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        stats[tile] = TileStats{tiles[tile], self, seconds};
+        busy[self] += seconds;
+      }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; ++t) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto &th : pool) th.join();
+  }
+
+  // load balance of the last run
+  void report(std::ostream &os) const {
+    if (stats.empty()) return;
+    double total = 0, minTile = stats[0].seconds, maxTile = 0;
+    for (const auto &s : stats) {
+      total += s.seconds;
+      minTile = std::min(minTile, s.seconds);
+      maxTile = std::max(maxTile, s.seconds);
+    }
+    double maxBusy = *std::max_element(busy.begin(), busy.end());
+    os << std::fixed << std::setprecision(3);
+    os << "tiles: " << stats.size() << ", threads: " << threads
+       << ", tile time min/avg/max: " << minTile * 1e3 << "/"
+       << total / stats.size() * 1e3 << "/" << maxTile * 1e3 << " ms"
+       << std::endl;
+    for (int t = 0; t < threads; ++t) {
+      int count = 0;
+      for (const auto &s : stats) count += s.thread == t;
+      os << "  thread " << t << ": " << count << " tiles, " << steals[t]
+         << " stolen, busy " << busy[t] << "s" << std::endl;
+    }
+    os << "load balance (avg/max busy): " << total / threads / maxBusy
+       << std::endl;
+    os << std::defaultfloat;
+  }
+
+ private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<int> tiles;
+  };
+
+  static int defaultThreads() {
+    return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+
+  static uint64_t morton(uint32_t x, uint32_t y) {
+    auto spread = [](uint64_t v) {
+      v &= 0xffffffff;
+      v = (v | (v << 16)) & 0x0000ffff0000ffffull;
+      v = (v | (v << 8)) & 0x00ff00ff00ff00ffull;
+      v = (v | (v << 4)) & 0x0f0f0f0f0f0f0f0full;
+      v = (v | (v << 2)) & 0x3333333333333333ull;
+      v = (v | (v << 1)) & 0x5555555555555555ull;
+      return v;
+    };
+    return spread(x) | (spread(y) << 1);
+  }
+
+  int threads;
+  std::vector<Tile> tiles;
+  std::vector<TileStats> stats;
+  std::vector<double> busy;
+  std::vector<int> steals;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef TONE_MAP_H_
+#define TONE_MAP_H_
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+// linear radiance to display values, kept apart from rendering so a saved
+// HDR buffer can be re-exposed without re-rendering. The passes run over
+// flat float arrays (3 per pixel) with the operator chosen outside the
+// loop, so each loop is a plain element-wise kernel the compiler vectorizes
+enum class ToneMapOperator { Clamp, Reinhard, ACES };
+
+struct ToneMapSettings {
+  ToneMapOperator op = ToneMapOperator::Clamp;
+  // in stops, radiance is scaled by 2^exposure first
+  float exposure = 0;
+  // display gamma, values are raised to 1 / gamma
+  float gamma = 2;
+};
+
+inline const char *toneMapName(ToneMapOperator op) {
+  switch (op) {
+    case ToneMapOperator::Reinhard:
+      return "reinhard";
+    case ToneMapOperator::ACES:
+      return "aces";
+    default:
+      return "clamp";
+  }
+}
+
+inline bool parseToneMapOperator(const std::string &name, ToneMapOperator &op) {
+  for (auto o : {ToneMapOperator::Clamp, ToneMapOperator::Reinhard,
+                 ToneMapOperator::ACES}) {
+    if (name == toneMapName(o)) {
+      op = o;
+      return true;
+    }
+  }
+  return false;
+}
+
+namespace tonemap_detail {
+
+template <typename Curve>
+inline void applyCurve(float *v, size_t n, float scale, Curve curve) {
+  for (size_t i = 0; i < n; ++i) {
+    float x = curve(std::max(v[i] * scale, 0.0f));
+    v[i] = std::min(x, 1.0f);
+  }
+}
+
+}  // namespace tonemap_detail
+
+// n linear values to [0, 1] display values, in place
+inline void toneMap(float *v, size_t n, const ToneMapSettings &s) {
+  using namespace tonemap_detail;
+  float scale = std::exp2(s.exposure);
+  switch (s.op) {
+    case ToneMapOperator::Clamp:
+      applyCurve(v, n, scale, [](float x) { return x; });
+      break;
+    case ToneMapOperator::Reinhard:
+      applyCurve(v, n, scale, [](float x) { return x / (1 + x); });
+      break;
+    case ToneMapOperator::ACES:
+      // Narkowicz's fit of the ACES filmic curve
+      applyCurve(v, n, scale, [](float x) {
+        return x * (2.51f * x + 0.03f) / (x * (2.43f * x + 0.59f) + 0.14f);
+      });
+      break;
+  }
+  if (s.gamma == 2) {
+    for (size_t i = 0; i < n; ++i) v[i] = std::sqrt(v[i]);
+  } else if (s.gamma != 1) {
+    float e = 1 / s.gamma;
+    for (size_t i = 0; i < n; ++i) v[i] = std::pow(v[i], e);
+  }
+}
+
+// display values in [0, 1] to 8 bits
+inline void quantize(const float *v, size_t n, unsigned char *out) {
+  for (size_t i = 0; i < n; ++i)
+    out[i] = static_cast<unsigned char>(static_cast<int>(v[i] * 255.99));
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef TRANSFORM_H_
+#define TRANSFORM_H_
+#include "AABB.h"
+#include "Ray.h"
+#include <cmath>
+
+// affine transform as a 3x4 row-major matrix (the last row is 0 0 0 1)
+struct Transform {
+  Transform() : m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}} {}
+
+  static Transform translate(const Vec3f &d) {
+    Transform t;
+    for (int i = 0; i < 3; ++i) t.m[i][3] = d[i];
+    return t;
+  }
+
+  static Transform scale(float x, float y, float z) {
+    Transform t;
+    t.m[0][0] = x, t.m[1][1] = y, t.m[2][2] = z;
+    return t;
+  }
+
+  static Transform scale(float s) { return scale(s, s, s); }
+
+  // about the y axis, in degrees
+  static Transform rotateY(float degrees) {
+    float theta = degrees * 3.14159265f / 180;
+    Transform t;
+    t.m[0][0] = std::cos(theta), t.m[0][2] = std::sin(theta);
+    t.m[2][0] = -std::sin(theta), t.m[2][2] = std::cos(theta);
+    return t;
+  }
+
+  // applies o first, then this
+  Transform operator*(const Transform &o) const {
+    Transform t;
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 4; ++j) {
+        t.m[i][j] = m[i][0] * o.m[0][j] + m[i][1] * o.m[1][j] +
+                    m[i][2] * o.m[2][j] + (j == 3 ? m[i][3] : 0);
+      }
+    }
+    return t;
+  }
+
+  Transform inverse() const {
+    // inverse of the linear part by cofactors, then the translation
+    float a = m[0][0], b = m[0][1], c = m[0][2];
+    float d = m[1][0], e = m[1][1], f = m[1][2];
+    float g = m[2][0], h = m[2][1], k = m[2][2];
+    float det = a * (e * k - f * h) - b * (d * k - f * g) + c * (d * h - e * g);
+    float s = 1 / det;
+    Transform t;
+    t.m[0][0] = (e * k - f * h) * s;
+    t.m[0][1] = (c * h - b * k) * s;
+    t.m[0][2] = (b * f - c * e) * s;
+    t.m[1][0] = (f * g - d * k) * s;
+    t.m[1][1] = (a * k - c * g) * s;
+    t.m[1][2] = (c * d - a * f) * s;
+    t.m[2][0] = (d * h - e * g) * s;
+    t.m[2][1] = (b * g - a * h) * s;
+    t.m[2][2] = (a * e - b * d) * s;
+    for (int i = 0; i < 3; ++i) {
+      t.m[i][3] = -(t.m[i][0] * m[0][3] + t.m[i][1] * m[1][3] +
+                    t.m[i][2] * m[2][3]);
+    }
+    return t;
+  }
+
+  Point3f point(const Point3f &p) const {
+    return Point3f(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                   m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                   m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+  }
+
+  Vec3f vector(const Vec3f &v) const {
+    return Vec3f(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                 m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                 m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+  }
+
+  // normals go through the transposed inverse, so call this on the inverse
+  Vec3f normal(const Vec3f &n) const {
+    return Vec3f(m[0][0] * n.x + m[1][0] * n.y + m[2][0] * n.z,
+                 m[0][1] * n.x + m[1][1] * n.y + m[2][1] * n.z,
+                 m[0][2] * n.x + m[1][2] * n.y + m[2][2] * n.z);
+  }
+
+  // the direction is not renormalized, so t is the same in both spaces
+  Ray ray(const Ray &r) const { return Ray(point(r.origin), vector(r.dir)); }
+
+  AABB box(const AABB &b) const {
+    AABB out;
+    for (int i = 0; i < 8; ++i) {
+      out.expand(point(Point3f(i & 1 ? b.max.x : b.min.x,
+                               i & 2 ? b.max.y : b.min.y,
+                               i & 4 ? b.max.z : b.min.z)));
+    }
+    return out;
+  }
+
+  float m[3][4];
+};
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef WAVEFRONT_H_
+#define WAVEFRONT_H_
+#include "Renderer.h"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <thread>
+
+// rays of all live paths in structure-of-arrays form
+struct PathQueue {
+  void resize(size_t n) {
+    ox.resize(n), oy.resize(n), oz.resize(n);
+    dx.resize(n), dy.resize(n), dz.resize(n);
+    tr.resize(n), tg.resize(n), tb.resize(n);
+    sample.resize(n);
+    sampler.resize(n);
+    size = n;
+  }
+
+  Ray ray(size_t i) const {
+    return Ray(Point3f(ox[i], oy[i], oz[i]), Vec3f(dx[i], dy[i], dz[i]));
+  }
+
+  void setRay(size_t i, const Ray &r) {
+    ox[i] = r.origin.x, oy[i] = r.origin.y, oz[i] = r.origin.z;
+    dx[i] = r.dir.x, dy[i] = r.dir.y, dz[i] = r.dir.z;
+  }
+
+  Color3f throughput(size_t i) const { return Color3f(tr[i], tg[i], tb[i]); }
+
+  void setThroughput(size_t i, const Color3f &c) {
+    tr[i] = c.r(), tg[i] = c.g(), tb[i] = c.b();
+  }
+
+  // copies path j of o into slot i
+  void copy(size_t i, const PathQueue &o, size_t j) {
+    ox[i] = o.ox[j], oy[i] = o.oy[j], oz[i] = o.oz[j];
+    dx[i] = o.dx[j], dy[i] = o.dy[j], dz[i] = o.dz[j];
+    tr[i] = o.tr[j], tg[i] = o.tg[j], tb[i] = o.tb[j];
+    sample[i] = o.sample[j];
+    sampler[i] = o.sampler[j];
+  }
+
+  std::vector<float> ox, oy, oz;
+  std::vector<float> dx, dy, dz;
+  std::vector<float> tr, tg, tb;  // throughput
+  std::vector<uint32_t> sample;   // index of the sample within the wave
+  std::vector<Sampler> sampler;
+  size_t size = 0;
+};
+
+// stream path tracer: a wave of samples is generated up front, then every
+// bounce runs as separate data-parallel stages over all live paths
+// (extend, sort by material kind, shade each kind in a batch, compact).
+// It consumes sampler dimensions exactly like rayColor, so for the same
+// settings it produces the same image as Renderer (without progressive or
+// adaptive sampling)
+class WavefrontRenderer {
+ public:
+  WavefrontRenderer(const RenderSettings &settings, const Camera &cam,
+                    const Hitable &world, const MaterialTable &materials,
+                    size_t waveSize = 1 << 20)
+      : settings(settings),
+        cam(cam),
+        world(world),
+        materials(materials),
+        film(settings.width, settings.filmHeight()),
+        threads(settings.threads > 0
+                    ? settings.threads
+                    : std::max(1, static_cast<int>(
+                                      std::thread::hardware_concurrency()))),
+        waveSize(waveSize) {}
+
+  RenderStats render(const std::function<void(const Film &)> &onPass = {}) {
+    auto start = std::chrono::high_resolution_clock::now();
+    RenderStats stats;
+    long long pixels =
+        static_cast<long long>(settings.width) * settings.filmHeight();
+    long long wavePixels =
+        std::max<long long>(1, static_cast<long long>(waveSize) / settings.spp);
+    for (long long p0 = 0; p0 < pixels; p0 += wavePixels)
+      renderWave(p0, std::min(pixels, p0 + wavePixels), stats);
+    if (onPass) onPass(film);
+    auto end = std::chrono::high_resolution_clock::now();
+    stats.seconds = std::chrono::duration<double>(end - start).count();
+    return stats;
+  }
+
+  const RenderSettings settings;
+  const Camera &cam;
+  const Hitable &world;
+  const MaterialTable &materials;
+  Film film;
+  const int threads;
+
+ private:
+  // sort keys: one per material kind plus misses and finished paths; after
+  // shading, surviving paths are marked ALIVE
+  enum Key { ALIVE = 0, MISS = 3, DEAD = 4, KEYS = 5 };
+  static const int CHUNKS = 64;
+
+  // stable counting sort of the live paths by key into order; offsets[k] is
+  // where key k starts. Chunks are counted and scattered in parallel
+  void sortByKey(std::array<size_t, KEYS + 1> &offsets) {
+    size_t n = paths.size;
+    std::vector<std::array<size_t, KEYS> > counts(CHUNKS);
+    order.resize(n);
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (int c = 0; c < CHUNKS; ++c) {
+      counts[c].fill(0);
+      for (size_t i = n * c / CHUNKS; i < n * (c + 1) / CHUNKS; ++i)
+        ++counts[c][keys[i]];
+    }
+    size_t total = 0;
+    for (int k = 0; k < KEYS; ++k) {
+      offsets[k] = total;
+      for (int c = 0; c < CHUNKS; ++c) {
+        size_t count = counts[c][k];
+        counts[c][k] = total;
+        total += count;
+      }
+    }
+    offsets[KEYS] = total;
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (int c = 0; c < CHUNKS; ++c) {
+      for (size_t i = n * c / CHUNKS; i < n * (c + 1) / CHUNKS; ++i)
+        order[counts[c][keys[i]]++] = static_cast<uint32_t>(i);
+    }
+  }
+
+  void generate(long long p0, long long p1) {
+    const int spp = settings.spp;
+    size_t n = static_cast<size_t>(p1 - p0) * spp;
+    paths.resize(n);
+    radiance.assign(n, Color3f(0, 0, 0));
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long long k = 0; k < static_cast<long long>(n); ++k) {
+      long long pixel = p0 + k / spp;
+      int s = static_cast<int>(k % spp);
+      int i = static_cast<int>(pixel % settings.width);
+      // film pixels are numbered from the band's first row
+      int j = static_cast<int>(pixel / settings.width) + settings.bandY0;
+      Sampler sampler(settings.sampler,
+                      static_cast<uint64_t>(j) * settings.width + i, s,
+                      settings.spp, settings.seed);
+      Sample2 jitter = sampler.get2D();
+      float u = (i + jitter.x) / settings.width;
+      float v = (j + jitter.y) / settings.height;
+      paths.setRay(k, cam.getRay(u, v, sampler));
+      paths.setThroughput(k, Color3f(1.0f, 1.0f, 1.0f));
+      paths.sample[k] = static_cast<uint32_t>(k);
+      paths.sampler[k] = sampler;
+    }
+  }
+
+  void extend() {
+    size_t n = paths.size;
+    hits.resize(n);
+    keys.resize(n);
+#pragma omp parallel for num_threads(threads) schedule(dynamic, 1024)
+    for (long long k = 0; k < static_cast<long long>(n); ++k) {
+      if (world.hit(paths.ray(k), 0.001f,
+                    std::numeric_limits<float>::infinity(), hits[k]))
+        keys[k] = static_cast<uint8_t>(materials[hits[k].materialId]->kind);
+      else
+        keys[k] = MISS;
+    }
+  }
+
+  void shadeMiss(size_t begin, size_t end) {
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long long q = begin; q < static_cast<long long>(end); ++q) {
+      uint32_t k = order[q];
+      auto uDir = normalize(Vec3f(paths.dx[k], paths.dy[k], paths.dz[k]));
+      float t = 0.5f * (uDir.y + 1);
+      radiance[paths.sample[k]] =
+          paths.throughput(k) *
+          ((1 - t) * Vec3f(1.0f, 1.0f, 1.0f) + t * Vec3f(0.5f, 0.7f, 1.0f));
+      keys[k] = DEAD;
+    }
+  }
+
+  // the concrete scatter is called non-virtually so the batch loop can be
+  // inlined; russian roulette follows rayColor exactly
+  template <typename M>
+  void shade(size_t begin, size_t end, int depth) {
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long long q = begin; q < static_cast<long long>(end); ++q) {
+      uint32_t k = order[q];
+      Ray r = paths.ray(k);
+      const HitRecord &rec = hits[k];
+      const M &material = static_cast<const M &>(*materials[rec.materialId]);
+      Ray scattered;
+      Color3f attenuation;
+      Sampler &sampler = paths.sampler[k];
+      keys[k] = DEAD;
+      if (!material.M::scatter(r, rec, attenuation, scattered, sampler))
+        continue;
+      Color3f throughput = paths.throughput(k) * attenuation;
+      if (settings.rouletteDepth >= 0 && depth + 1 >= settings.rouletteDepth) {
+        float survive = std::min(
+            std::max({throughput.r(), throughput.g(), throughput.b()}),
+            settings.rouletteMaxSurvival);
+        if (sampler.get1D() >= survive) continue;
+        throughput /= survive;
+      }
+      paths.setRay(k, scattered);
+      paths.setThroughput(k, throughput);
+      keys[k] = ALIVE;
+    }
+  }
+
+  // keeps the ALIVE paths, in their current order
+  void compact() {
+    std::array<size_t, KEYS + 1> offsets;
+    sortByKey(offsets);
+    size_t alive = offsets[ALIVE + 1];
+    next.resize(alive);
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long long q = 0; q < static_cast<long long>(alive); ++q)
+      next.copy(q, paths, order[q]);
+    std::swap(paths, next);
+  }
+
+  void renderWave(long long p0, long long p1, RenderStats &stats) {
+    generate(p0, p1);
+    for (int depth = 0; depth < settings.maxDepth && paths.size > 0; ++depth) {
+      stats.rays += paths.size;
+      extend();
+      std::array<size_t, KEYS + 1> offsets;
+      sortByKey(offsets);
+      auto range = [&](int key) {
+        return std::make_pair(offsets[key], offsets[key + 1]);
+      };
+      auto miss = range(MISS);
+      shadeMiss(miss.first, miss.second);
+      auto lambertian = range(static_cast<int>(MaterialKind::Lambertian));
+      shade<Lambertian>(lambertian.first, lambertian.second, depth);
+      auto metal = range(static_cast<int>(MaterialKind::Metal));
+      shade<Metal>(metal.first, metal.second, depth);
+      auto dielectric = range(static_cast<int>(MaterialKind::Dielectric));
+      shade<Dielectric>(dielectric.first, dielectric.second, depth);
+      compact();
+    }
+    // samples go to the film in sample order, as Renderer adds them
+    const int spp = settings.spp;
+#pragma omp parallel for num_threads(threads) schedule(static)
+    for (long long pixel = p0; pixel < p1; ++pixel) {
+      int i = static_cast<int>(pixel % settings.width);
+      int j = static_cast<int>(pixel / settings.width);
+      for (int s = 0; s < spp; ++s)
+        film.add(i, j, radiance[(pixel - p0) * spp + s]);
+    }
+    stats.samples += (p1 - p0) * spp;
+  }
+
+  size_t waveSize;
+  PathQueue paths, next;
+  std::vector<HitRecord> hits;
+  std::vector<uint8_t> keys;
+  std::vector<uint32_t> order;
+  std::vector<Color3f> radiance;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// a small benchmark harness: a case is a batch function that performs a
+// fixed number of operations and returns how many rays it traced. Batches
+// repeat until minSeconds have passed (at least minBatches times) and the
+// fastest batch counts, which is the least disturbed by everything else
+// running on the machine. Results go out as JSON, one case per line, and
+// can be compared against an earlier run
+struct BenchResult {
+  std::string name;
+  long long ops = 0;   // per batch
+  long long rays = 0;  // per batch
+  int batches = 0;
+  double seconds = 0;  // of the fastest batch
+
+  double nsPerOp() const { return seconds / ops * 1e9; }
+  double nsPerRay() const { return rays ? seconds / rays * 1e9 : 0; }
+  double raysPerSecond() const { return rays / seconds; }
+};
+
+// written to, so the compiler can't drop a batch's work
+static volatile double benchSink;
+
+class BenchSuite {
+ public:
+  double minSeconds = 0.5;
+  int minBatches = 3;
+  std::string filter;  // run only cases whose name contains it
+
+  template <typename F>
+  void run(const std::string &name, long long ops, F &&batch) {
+    if (name.find(filter) == std::string::npos) return;
+    BenchResult r;
+    r.name = name;
+    r.ops = ops;
+    r.rays = batch();  // warm up
+    double total = 0;
+    while (r.batches < minBatches || total < minSeconds) {
+      auto start = std::chrono::high_resolution_clock::now();
+      batch();
+      auto end = std::chrono::high_resolution_clock::now();
+      double s = std::chrono::duration<double>(end - start).count();
+      r.seconds = r.batches++ ? std::min(r.seconds, s) : s;
+      total += s;
+    }
+    std::cerr << name << ": " << r.nsPerOp() << " ns/op";
+    if (r.rays) std::cerr << ", " << r.raysPerSecond() / 1e6 << " Mrays/s";
+    std::cerr << std::endl;
+    results.push_back(r);
+  }
+
+  // context is a JSON object body, e.g. "\"threads\": 8"
+  void writeJson(std::ostream &os, const std::string &context) const {
+    os << "{\"context\": {" << context << "},\n\"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+      const BenchResult &r = results[i];
+      os << "{\"name\": \"" << r.name << "\", \"ops\": " << r.ops
+         << ", \"batches\": " << r.batches << ", \"seconds\": " << r.seconds
+         << ", \"ns_per_op\": " << r.nsPerOp() << ", \"rays\": " << r.rays
+         << ", \"rays_per_second\": " << (r.rays ? r.raysPerSecond() : 0)
+         << ", \"ns_per_ray\": " << r.nsPerRay() << "}"
+         << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "]}" << std::endl;
+  }
+
+  // ns_per_op by name from a file written by writeJson
+  static bool readJson(const std::string &path,
+                       std::map<std::string, double> &nsPerOp) {
+    std::ifstream file(path);
+    if (!file) {
+      std::cerr << "[ERROR] Failed to open " << path << std::endl;
+      return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+      std::string name = field(line, "name");
+      std::string ns = field(line, "ns_per_op");
+      if (!name.empty() && !ns.empty()) nsPerOp[name] = atof(ns.c_str());
+    }
+    return true;
+  }
+
+  // prints the change of every case also in baseline; false if any got
+  // slower by more than tolerance (0.1 -> 10%)
+  bool compare(const std::map<std::string, double> &baseline,
+               double tolerance) const {
+    bool ok = true;
+    for (const BenchResult &r : results) {
+      auto it = baseline.find(r.name);
+      if (it == baseline.end() || it->second <= 0) continue;
+      double change = r.nsPerOp() / it->second - 1;
+      bool regressed = change > tolerance;
+      ok = ok && !regressed;
+      fprintf(stderr, "%-28s %10.1f -> %10.1f ns/op %+6.1f%%%s\n",
+              r.name.c_str(), it->second, r.nsPerOp(), change * 100,
+              regressed ? "  REGRESSION" : "");
+    }
+    return ok;
+  }
+
+  std::vector<BenchResult> results;
+
+ private:
+  // the raw value of "key": in a one-line JSON object, quotes stripped
+  static std::string field(const std::string &line, const std::string &key) {
+    std::string tag = "\"" + key + "\": ";
+    size_t begin = line.find(tag);
+    if (begin == std::string::npos) return "";
+    begin += tag.size();
+    if (line[begin] == '"') {
+      size_t end = line.find('"', begin + 1);
+      return end == std::string::npos ? ""
+                                      : line.substr(begin + 1, end - begin - 1);
+    }
+    size_t end = line.find_first_of(",}", begin);
+    return line.substr(begin, end - begin);
+  }
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "Camera.h"
+#include "Scene.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// primary ray throughput of the scene accelerators on the random scene,
+// then build time and quality of both SphereBVH builders on random-big
+// usage: bench_bvh [width] [height] [spp]
+
+template <typename F>
+void measure(const std::string &name, size_t rays, F &&trace) {
+  auto start = std::chrono::high_resolution_clock::now();
+  size_t hits = trace();
+  auto end = std::chrono::high_resolution_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << name << ": " << rays / seconds / 1e6 << " Mrays/s ("
+            << seconds << "s, " << hits << " hits)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  int width = argc > 1 ? atoi(argv[1]) : 640;
+  int height = argc > 2 ? atoi(argv[2]) : 360;
+  int spp = argc > 3 ? atoi(argv[3]) : RayPacket::SIZE;
+
+  Point3f lookfrom(13, 2, 3), lookat(0, 0, 0), up(0, 1, 0);
+  Camera cam(lookfrom, lookat, up, 20, static_cast<float>(width) / height,
+             0.1f, 10.0f);
+  Scene scene;
+  makeScene("random", 0, scene);
+  const std::vector<Sphere> &spheres = scene.spheres;
+  HitList list = toHitList(spheres);
+  BVHNode tree(list);
+  SphereBVH flat(spheres);
+  std::cout << spheres.size() << " spheres, " << flat.nodes.size()
+            << " linear BVH nodes, SIMD width " << SphereSoA::WIDTH
+            << std::endl;
+
+  // the samples of a pixel are stored together so packets stay coherent
+  std::vector<Ray> rays;
+  rays.reserve(static_cast<size_t>(width) * height * spp);
+  for (int j = 0; j < height; ++j) {
+    for (int i = 0; i < width; ++i) {
+      for (int s = 0; s < spp; ++s) {
+        Sampler sampler(SamplerKind::Independent,
+                        static_cast<uint64_t>(j) * width + i, s, spp);
+        Sample2 jitter = sampler.get2D();
+        float u = (i + jitter.x) / width;
+        float v = (j + jitter.y) / height;
+        rays.push_back(cam.getRay(u, v, sampler));
+      }
+    }
+  }
+
+  const float tMin = 0.001f;
+  const float tMax = std::numeric_limits<float>::infinity();
+  auto traceAll = [&](const Hitable &world) {
+    return [&]() {
+      size_t hits = 0;
+      HitRecord rec;
+      for (const auto &r : rays) hits += world.hit(r, tMin, tMax, rec);
+      return hits;
+    };
+  };
+  measure("HitList", rays.size(), traceAll(list));
+  measure("SphereSoA", rays.size(), [&]() {
+    size_t hits = 0;
+    for (const auto &r : rays) {
+      float t = tMax;
+      hits += flat.spheres.closestHit(r, 0, flat.spheres.size(), tMin, t) >= 0;
+    }
+    return hits;
+  });
+  measure("BVHNode", rays.size(), traceAll(tree));
+  measure("SphereBVH", rays.size(), traceAll(flat));
+  measure("SphereBVH packet", rays.size(), [&]() {
+    size_t hits = 0;
+    RayPacket packet;
+    HitRecord recs[RayPacket::SIZE];
+    bool hit[RayPacket::SIZE];
+    for (size_t i = 0; i < rays.size(); i += RayPacket::SIZE) {
+      packet.size = 0;
+      for (size_t k = i; k < rays.size() && packet.size < RayPacket::SIZE; ++k)
+        packet.rays[packet.size++] = rays[k];
+      flat.hitPacket(packet, tMin, tMax, recs, hit);
+      for (int k = 0; k < packet.size; ++k) hits += hit[k];
+    }
+    return hits;
+  });
+
+  SphereBVH lbvh(spheres, BVHBuildMethod::LBVH);
+  measure("SphereBVH lbvh", rays.size(), traceAll(lbvh));
+
+  Scene big;
+  makeScene("random-big", 0, big);
+  for (auto method : {BVHBuildMethod::SAH, BVHBuildMethod::LBVH}) {
+    SphereBVH world(big.spheres, method);
+    world.buildStats.print(std::cout, "random-big sphere");
+    measure(std::string("random-big ") + bvhMethodName(method), rays.size(),
+            traceAll(world));
+  }
+}
@@ -0,0 +1,128 @@
+#include "Scene.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// cost of evaluating the surface for every candidate hit (the old
+// Sphere::hit) versus intersect() + one surface() for the closest hit, on
+// primary and first-bounce rays of the random scene
+// usage: bench_deferred [width] [height]
+
+// the old eager path: every sphere that passes the interval test fills a
+// full record, which HitList then copied into the result
+bool eagerHit(const std::vector<Sphere> &spheres, const Ray &r, float tMin,
+              float tMax, HitRecord &rec, long long &surfaces) {
+  HitRecord tmpRec;
+  bool hitAny = false;
+  for (const auto &s : spheres) {
+    Vec3f oc = r.origin - s.center;
+    auto a = r.dir.norm2();
+    auto halfB = dot(oc, r.dir);
+    auto c = oc.norm2() - s.radius * s.radius;
+    auto delta = halfB * halfB - a * c;
+    if (delta <= 0) continue;
+    delta = std::sqrt(delta);
+    auto tmp = (-halfB - delta) / a;
+    if (!(tmp < tMax && tmp > tMin)) tmp = (-halfB + delta) / a;
+    if (tmp < tMax && tmp > tMin) {
+      ++surfaces;
+      tmpRec.t = tmp;
+      tmpRec.p = r.at(tmp);
+      tmpRec.setFaceNormal(r, (tmpRec.p - s.center) / s.radius);
+      tmpRec.materialId = s.materialId;
+      hitAny = true;
+      tMax = tmp;
+      rec = tmpRec;
+    }
+  }
+  return hitAny;
+}
+
+// the same loop keeping only t and the sphere, resolving the surface once
+bool deferredHit(const std::vector<Sphere> &spheres, const Ray &r, float tMin,
+                 float tMax, HitRecord &rec, long long &surfaces) {
+  Intersection isect;
+  bool hitAny = false;
+  for (const auto &s : spheres) {
+    if (s.Sphere::intersect(r, tMin, tMax, isect)) {
+      hitAny = true;
+      tMax = isect.t;
+    }
+  }
+  if (!hitAny) return false;
+  ++surfaces;
+  isect.object->surface(r, isect, rec);
+  return true;
+}
+
+template <typename F>
+void measure(const std::string &name, size_t rays, F &&trace) {
+  auto start = std::chrono::high_resolution_clock::now();
+  long long surfaces = 0;
+  size_t hits = trace(surfaces);
+  auto end = std::chrono::high_resolution_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  std::cout << name << ": " << seconds / rays * 1e9 << " ns/ray, "
+            << static_cast<double>(surfaces) / rays
+            << " surface evaluations/ray (" << hits << " hits)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  int width = argc > 1 ? atoi(argv[1]) : 320;
+  int height = argc > 2 ? atoi(argv[2]) : 180;
+
+  Scene scene;
+  makeScene("random", 0, scene);
+  Camera cam = scene.camera.makeCamera(static_cast<float>(width) / height);
+  SphereBVH flat(scene.spheres);
+
+  const float tMin = 0.001f;
+  const float tMax = std::numeric_limits<float>::infinity();
+  std::vector<Ray> rays;
+  for (int j = 0; j < height; ++j) {
+    for (int i = 0; i < width; ++i) {
+      Sampler sampler(SamplerKind::Independent,
+                      static_cast<uint64_t>(j) * width + i, 0, 1);
+      Sample2 jitter = sampler.get2D();
+      float u = (i + jitter.x) / width;
+      float v = (j + jitter.y) / height;
+      Ray r = cam.getRay(u, v, sampler);
+      rays.push_back(r);
+      HitRecord rec;
+      Ray scattered;
+      Color3f attenuation;
+      if (flat.hit(r, tMin, tMax, rec) &&
+          scene.materials[rec.materialId]->scatter(r, rec, attenuation,
+                                                   scattered, sampler))
+        rays.push_back(scattered);
+    }
+  }
+  std::cout << scene.spheres.size() << " spheres, " << rays.size() << " rays"
+            << std::endl;
+
+  measure("eager linear", rays.size(), [&](long long &surfaces) {
+    size_t hits = 0;
+    HitRecord rec;
+    for (const auto &r : rays)
+      hits += eagerHit(scene.spheres, r, tMin, tMax, rec, surfaces);
+    return hits;
+  });
+  measure("deferred linear", rays.size(), [&](long long &surfaces) {
+    size_t hits = 0;
+    HitRecord rec;
+    for (const auto &r : rays)
+      hits += deferredHit(scene.spheres, r, tMin, tMax, rec, surfaces);
+    return hits;
+  });
+  measure("deferred SphereBVH", rays.size(), [&](long long &surfaces) {
+    size_t hits = 0;
+    HitRecord rec;
+    for (const auto &r : rays) {
+      bool hit = flat.hit(r, tMin, tMax, rec);
+      hits += hit;
+      surfaces += hit;
+    }
+    return hits;
+  });
+}
@@ -0,0 +1,91 @@
+#include "Scene.h"
+#include "Renderer.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+// renders a ~1M triangle mesh on a ground plane
+// usage: bench_mesh [obj] [width] [height] [spp]
+// without an OBJ a bumpy sphere is generated, written out and read back so
+// the loader is timed too
+
+double secondsSince(std::chrono::high_resolution_clock::time_point start) {
+  auto now = std::chrono::high_resolution_clock::now();
+  return std::chrono::duration<double>(now - start).count();
+}
+
+// rings * segments * 2 triangles
+bool writeBumpySphere(const std::string &path, int rings, int segments) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (!file) return false;
+  const float pi = 3.14159265f;
+  for (int i = 0; i <= rings; ++i) {
+    float theta = pi * i / rings;
+    for (int j = 0; j < segments; ++j) {
+      float phi = 2 * pi * j / segments;
+      float r = 1 + 0.05f * std::sin(12 * theta) * std::sin(16 * phi);
+      fprintf(file, "v %f %f %f\n", r * std::sin(theta) * std::cos(phi),
+              1 + r * std::cos(theta), r * std::sin(theta) * std::sin(phi));
+    }
+  }
+  for (int i = 0; i < rings; ++i) {
+    for (int j = 0; j < segments; ++j) {
+      int a = i * segments + j + 1;
+      int b = i * segments + (j + 1) % segments + 1;
+      fprintf(file, "f %d %d %d %d\n", a, b, b + segments, a + segments);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  std::string obj = argc > 1 ? argv[1] : "";
+  RenderSettings settings;
+  settings.width = argc > 2 ? atoi(argv[2]) : 640;
+  settings.height = argc > 3 ? atoi(argv[3]) : 360;
+  settings.spp = argc > 4 ? atoi(argv[4]) : 4;
+  settings.progressive = false;
+
+  bool generated = obj.empty();
+  if (generated) {
+    obj = "bench_mesh.obj";
+    if (!writeBumpySphere(obj, 500, 1000)) {
+      std::cerr << "[ERROR] Failed to write " << obj << std::endl;
+      return -1;
+    }
+  }
+
+  Scene scene;
+  auto ground = scene.addMaterial<Lambertian>(Color3f(0.5, 0.5, 0.5));
+  scene.spheres.emplace_back(Point3f(0, -1000, 0), 1000.0f, ground);
+  auto grey = scene.addMaterial<Lambertian>(Color3f(0.7, 0.7, 0.7));
+  auto mesh = std::make_shared<TriangleMesh>();
+  auto start = std::chrono::high_resolution_clock::now();
+  bool loaded = loadObj(obj, grey, *mesh);
+  double loadSeconds = secondsSince(start);
+  if (generated) remove(obj.c_str());
+  if (!loaded) return -1;
+  scene.meshes.push_back(mesh);
+  std::cout << mesh->triangleCount() << " triangles, "
+            << mesh->positions.size() << " vertices, load + build "
+            << loadSeconds << "s" << std::endl;
+  // loadObj includes a SAH build; the LBVH one is timed on its own, then
+  // the mesh is rendered with the SAH tree
+  mesh->build(BVHBuildMethod::LBVH);
+  mesh->buildStats.print(std::cout, "mesh");
+  mesh->build(BVHBuildMethod::SAH);
+  mesh->buildStats.print(std::cout, "mesh");
+
+  auto world = buildWorld(scene);
+  Camera cam = scene.camera.makeCamera(static_cast<float>(settings.width) /
+                                       settings.height);
+  Renderer renderer(settings, cam, *world, scene.materials);
+  RenderStats stats = renderer.render();
+  std::cout << "render: " << stats.seconds << "s, " << stats.rays / 1e6
+            << " Mrays, " << stats.rays / stats.seconds / 1e6 << " Mrays/s"
+            << std::endl;
+}
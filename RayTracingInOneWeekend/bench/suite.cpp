@@ -0,0 +1,211 @@
+#include "Bench.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// micro and full-frame benchmarks of the path tracer on the random scene
+// with fixed seeds, as JSON for tracking ns/op and rays/s across commits
+// usage: bench_suite [--filter SUBSTR] [--min-time S] [--threads N]
+//                    [--output PATH] [--compare BASELINE] [--tolerance F]
+// with --compare the exit code is 1 if any case common to both runs got
+// slower than the baseline by more than the tolerance (0.1 = 10%)
+
+const float T_MIN = 0.001f;
+const float T_MAX = std::numeric_limits<float>::infinity();
+
+// a pixel's first sample, for inputs that look like a real render
+Ray primaryRay(const Camera &cam, int i, int j, int width, int height,
+               Sampler &sampler) {
+  sampler = Sampler(SamplerKind::Sobol, static_cast<uint64_t>(j) * width + i,
+                    0, 1);
+  Sample2 jitter = sampler.get2D();
+  float u = (i + jitter.x) / width;
+  float v = (j + jitter.y) / height;
+  return cam.getRay(u, v, sampler);
+}
+
+int main(int argc, char **argv) {
+  BenchSuite suite;
+  int threads = 0;
+  std::string output, baselinePath;
+  double tolerance = 0.1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char * {
+      if (i + 1 >= argc) {
+        std::cerr << "[ERROR] Missing value for " << arg << std::endl;
+        exit(-1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--filter") {
+      suite.filter = value();
+    } else if (arg == "--min-time") {
+      suite.minSeconds = atof(value());
+    } else if (arg == "--threads") {
+      threads = atoi(value());
+    } else if (arg == "--output") {
+      output = value();
+    } else if (arg == "--compare") {
+      baselinePath = value();
+    } else if (arg == "--tolerance") {
+      tolerance = atof(value());
+    } else {
+      std::cerr << "[ERROR] Unknown option " << arg << std::endl;
+      return -1;
+    }
+  }
+  std::map<std::string, double> baseline;
+  if (!baselinePath.empty() && !BenchSuite::readJson(baselinePath, baseline))
+    return -1;
+  if (threads <= 0)
+    threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+  Scene scene;
+  makeScene("random", 0, scene);
+  const int width = 320, height = 180;
+  Camera cam = scene.camera.makeCamera(static_cast<float>(width) / height);
+  auto world = buildWorld(scene);
+  HitList list = toHitList(scene.spheres);
+
+  // primary rays of every pixel, and the records and materials of the
+  // ones that hit
+  std::vector<Ray> rays;
+  std::vector<HitRecord> hits;
+  std::vector<Ray> hitRays;
+  for (int j = 0; j < height; ++j) {
+    for (int i = 0; i < width; ++i) {
+      Sampler sampler;
+      Ray r = primaryRay(cam, i, j, width, height, sampler);
+      rays.push_back(r);
+      HitRecord rec;
+      if (world->hit(r, T_MIN, T_MAX, rec)) {
+        hits.push_back(rec);
+        hitRays.push_back(r);
+      }
+    }
+  }
+  const long long n = rays.size();
+
+  // the big glass sphere in the middle of the frame
+  const Sphere &sphere = scene.spheres[scene.spheres.size() - 3];
+  suite.run("sphere/hit", n, [&]() {
+    HitRecord rec;
+    double sum = 0;
+    for (const auto &r : rays)
+      if (sphere.hit(r, T_MIN, T_MAX, rec)) sum += rec.t;
+    benchSink = sum;
+    return n;
+  });
+  suite.run("hitlist/hit", n, [&]() {
+    HitRecord rec;
+    double sum = 0;
+    for (const auto &r : rays)
+      if (list.hit(r, T_MIN, T_MAX, rec)) sum += rec.t;
+    benchSink = sum;
+    return n;
+  });
+  suite.run("world/hit", n, [&]() {
+    HitRecord rec;
+    double sum = 0;
+    for (const auto &r : rays)
+      if (world->hit(r, T_MIN, T_MAX, rec)) sum += rec.t;
+    benchSink = sum;
+    return n;
+  });
+  suite.run("camera/getRay", n, [&]() {
+    double sum = 0;
+    for (int k = 0; k < n; ++k) {
+      Sampler sampler(SamplerKind::Sobol, k, 0, 1);
+      Sample2 uv = sampler.get2D();
+      sum += cam.getRay(uv.x, uv.y, sampler).dir.x;
+    }
+    benchSink = sum;
+    return 0;
+  });
+
+  // every material kind scatters all the hits, as if it were theirs
+  std::vector<std::unique_ptr<Material> > materials;
+  materials.push_back(std::make_unique<Lambertian>(Color3f(0.5, 0.5, 0.5)));
+  materials.push_back(std::make_unique<Metal>(Color3f(0.7, 0.6, 0.5), 0.1f));
+  materials.push_back(std::make_unique<Dielectric>(1.5f));
+  const char *names[] = {"scatter/lambertian", "scatter/metal",
+                         "scatter/dielectric"};
+  const long long m = hits.size();
+  for (size_t k = 0; k < materials.size(); ++k) {
+    suite.run(names[k], m, [&]() {
+      Sampler sampler(SamplerKind::Sobol, 0, 0, 1);
+      double sum = 0;
+      Color3f attenuation;
+      Ray scattered;
+      for (long long h = 0; h < m; ++h) {
+        if (materials[k]->scatter(hitRays[h], hits[h], attenuation,
+                                  scattered, sampler))
+          sum += scattered.dir.y;
+      }
+      benchSink = sum;
+      return 0;
+    });
+  }
+
+  RenderSettings settings;
+  settings.width = width;
+  settings.height = height;
+  settings.threads = 1;
+  suite.run("rayColor", n, [&]() {
+    long long traced = 0;
+    double sum = 0;
+    for (int j = 0; j < height; ++j) {
+      for (int i = 0; i < width; ++i) {
+        Sampler sampler;
+        Ray r = primaryRay(cam, i, j, width, height, sampler);
+        sum += rayColor(r, *world, scene.materials, settings, sampler, traced)
+                   .g();
+      }
+    }
+    benchSink = sum;
+    return traced;
+  });
+
+  // whole frames, one pixel op per sample
+  settings.threads = threads;
+  settings.progressive = false;
+  settings.spp = 4;
+  const int sizes[][2] = {{160, 90}, {320, 180}, {640, 360}};
+  for (const auto &size : sizes) {
+    settings.width = size[0];
+    settings.height = size[1];
+    Camera frameCam =
+        scene.camera.makeCamera(static_cast<float>(size[0]) / size[1]);
+    std::string name = "frame/" + std::to_string(size[0]) + "x" +
+                       std::to_string(size[1]) + "x4spp";
+    suite.run(name, static_cast<long long>(size[0]) * size[1] * settings.spp,
+              [&]() {
+                Renderer renderer(settings, frameCam, *world, scene.materials);
+                return renderer.render().rays;
+              });
+  }
+
+  std::string context = "\"threads\": " + std::to_string(threads) +
+                        ", \"simd_width\": " +
+                        std::to_string(SphereSoA::WIDTH) +
+                        ", \"time\": " + std::to_string(time(nullptr));
+  if (output.empty()) {
+    suite.writeJson(std::cout, context);
+  } else {
+    std::ofstream file(output);
+    suite.writeJson(file, context);
+    if (!file) {
+      std::cerr << "[ERROR] Failed to write " << output << std::endl;
+      return -1;
+    }
+  }
+  if (!baselinePath.empty() && !suite.compare(baseline, tolerance)) return 1;
+}
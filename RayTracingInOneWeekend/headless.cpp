@@ -0,0 +1,508 @@
+#include "SceneFile.h"
+#include "Renderer.h"
+#include "Wavefront.h"
+#include "SceneCache.h"
+#include "ImageStream.h"
+#include "Checkpoint.h"
+#include "Distributed.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "ImageIO.h"
+
+// renders without any window or GL context; timings go to stdout as one
+// JSON object per scene, progress to stderr
+
+void usage(const char *name) {
+  std::cerr
+      << "usage: " << name << " [options]\n"
+      << "  --width N          image width (1920)\n"
+      << "  --height N         image height (1080)\n"
+      << "  --spp N            samples per pixel (64)\n"
+      << "  --depth N          max path depth (50)\n"
+      << "  --roulette-depth N bounces before russian roulette, -1 = off (3)\n"
+      << "  --survival F       max russian roulette survival (0.95)\n"
+      << "  --threads N        render threads, 0 = all cores (0)\n"
+      << "  --tile N           tile size (32)\n"
+      << "  --seed N           sampler and scene seed (0)\n"
+      << "  --sampler NAME     independent | stratified | sobol (sobol)\n"
+      << "  --scene NAME       random | random-big | random-instanced |\n"
+      << "                     instanced-huge | a scene file (random);\n"
+      << "                     repeat to render several scenes in turn\n"
+      << "  --bvh METHOD       sah | lbvh, overrides the scene's (sah)\n"
+      << "  --load-cache PATH  load a binary scene cache instead of --scene\n"
+      << "  --save-cache PATH  write the scene as a binary scene cache\n"
+      << "  --obj PATH         add a grey diffuse OBJ mesh to the scene\n"
+      << "  --output PATH      .png, .ppm or .pfm to write (output.png),\n"
+      << "                     with several scenes suffixed by the scene name\n"
+      << "  --hdr PATH         also write the linear image as a .pfm\n"
+      << "  --tonemap OP       clamp | reinhard | aces, for 8-bit output\n"
+      << "                     (clamp)\n"
+      << "  --exposure F       stops, scales radiance by 2^F (0)\n"
+      << "  --gamma F          display gamma (2)\n"
+      << "  --band N           render and write N rows at a time so memory\n"
+      << "                     stays bounded (.ppm or .pfm output only)\n"
+      << "  --progressive      render one sample per pixel per pass\n"
+      << "  --time-budget S    stop a progressive render after S seconds\n"
+      << "  --adaptive         variance-driven adaptive sampling\n"
+      << "  --min-spp N        adaptive: samples before testing (16)\n"
+      << "  --threshold F      adaptive: relative error target (0.05)\n"
+      << "  --heatmap PATH     adaptive: write samples per pixel\n"
+      << "  --checkpoint PATH  save the film every --checkpoint-interval\n"
+      << "                     seconds and when done (implies --progressive)\n"
+      << "  --checkpoint-interval S  (60)\n"
+      << "  --resume PATH      continue from a checkpoint to --spp\n"
+      << "  --cost PATH        write render time per pixel as a heat map\n"
+      << "  --cost-rays PATH   write rays traced per pixel as a heat map\n"
+      << "  --report           print the tile load balance report\n"
+      << "  --wavefront        stream path tracer (fixed spp only)\n"
+      << "  --workers N        render bands of rows in N forked processes;\n"
+      << "                     --threads is then per process (cores / N)\n";
+}
+
+struct Options {
+  RenderSettings settings;
+  std::string output = "output.png";
+  std::string heatmap;
+  std::string cost, costRays;
+  std::string hdr;
+  ToneMapSettings toneMapping;
+  std::string obj;
+  std::string loadCache, saveCache;
+  BVHBuildMethod bvh = BVHBuildMethod::SAH;
+  bool bvhSet = false;
+  bool report = false;
+  bool wavefront = false;
+  int band = 0;
+  int workers = 0;
+  std::string checkpoint, resume;
+  double checkpointInterval = 60;
+};
+
+// file name without directory and extension
+std::string stem(const std::string &path) {
+  size_t slash = path.find_last_of("/\\");
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  return name.substr(0, name.find('.'));
+}
+
+// s as the body of a JSON string
+std::string jsonEscape(const std::string &s) {
+  std::string out;
+  for (unsigned char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += static_cast<char>(c);
+    } else if (c < 0x20) {
+      char code[8];
+      snprintf(code, sizeof(code), "\\u%04x", c);
+      out += code;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  return out;
+}
+
+// path.png -> path_suffix.png
+std::string withSuffix(const std::string &path, const std::string &suffix) {
+  if (suffix.empty()) return path;
+  size_t dot = path.find_last_of('.');
+  size_t slash = path.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return path + "_" + suffix;
+  return path.substr(0, dot) + "_" + suffix + path.substr(dot);
+}
+
+int renderScene(const std::string &sceneName, const std::string &suffix,
+                const Options &o) {
+  const RenderSettings &settings = o.settings;
+  auto start = std::chrono::high_resolution_clock::now();
+  Scene scene;
+  if (!o.loadCache.empty()) {
+    // the cache brings its own BVHs, built with whatever method it used
+    if (!loadSceneCache(o.loadCache, scene)) return -1;
+  } else {
+    if (!loadScene(sceneName, settings.seed, scene,
+                   o.bvhSet ? &o.bvh : nullptr))
+      return -1;
+  }
+  if (!o.obj.empty()) {
+    auto mesh = std::make_shared<TriangleMesh>();
+    auto grey = scene.addMaterial<Lambertian>(Color3f(0.7, 0.7, 0.7));
+    if (!loadObj(o.obj, grey, *mesh, scene.bvh)) return -1;
+    scene.meshes.push_back(mesh);
+  }
+  if (!o.saveCache.empty()) {
+    if (!scene.sphereBVH)
+      scene.sphereBVH = std::make_shared<SphereBVH>(scene.spheres, scene.bvh);
+    if (!SceneCacheWriter::write(o.saveCache, scene)) return -1;
+  }
+  auto world = buildWorld(scene, &std::cerr);
+  auto built = std::chrono::high_resolution_clock::now();
+  Camera cam = scene.camera.makeCamera(static_cast<float>(settings.width) /
+                                       settings.height);
+
+  // a resumed render must see the same scene, --obj included: the key
+  // covers the names and the contents of the scene file and the OBJ (of a
+  // cache, its header and size; meshes a scene file references are only
+  // covered by their paths)
+  uint64_t sceneKey = checkpointSceneKey(sceneName + "\n" + o.obj);
+  if (!o.checkpoint.empty() || !o.resume.empty()) {
+    if (!o.loadCache.empty())
+      hashSceneSource(o.loadCache, sceneKey, sizeof(SceneCacheHeader));
+    else
+      hashSceneSource(sceneName, sceneKey);  // built-in names are no files
+    if (!o.obj.empty()) hashSceneSource(o.obj, sceneKey);
+  }
+  const std::string checkpoint = withSuffix(o.checkpoint, suffix);
+  auto lastCheckpoint = std::chrono::high_resolution_clock::now();
+  auto onPass = [&](const Film &film) {
+    auto now = std::chrono::high_resolution_clock::now();
+    if (o.checkpoint.empty() ||
+        std::chrono::duration<double>(now - lastCheckpoint).count() <
+            o.checkpointInterval)
+      return;
+    // a failed save is reported, the render goes on
+    saveCheckpoint(checkpoint, settings, sceneKey, film);
+    lastCheckpoint = now;
+  };
+
+  // hot path counters of the tile renderer (builds with RT_ENABLE_STATS)
+  std::vector<RenderCounters> counters;
+
+  // renders the rows settings selects and hands the film to done
+  auto renderFilm = [&](const RenderSettings &s,
+                        const std::function<bool(const Film &)> &done,
+                        RenderStats &total) {
+    std::unique_ptr<Renderer> renderer;
+    std::unique_ptr<WavefrontRenderer> stream;
+    std::unique_ptr<DistributedRenderer> shards;
+    if (o.workers > 0)
+      shards = std::make_unique<DistributedRenderer>(
+          s, cam, *world, scene.materials, o.workers, s.tileSize);
+    else if (o.wavefront)
+      stream =
+          std::make_unique<WavefrontRenderer>(s, cam, *world, scene.materials);
+    else
+      renderer = std::make_unique<Renderer>(s, cam, *world, scene.materials);
+    if (!o.resume.empty()) {
+      if (!loadCheckpoint(withSuffix(o.resume, suffix), s, sceneKey,
+                          renderer->film))
+        return false;
+      std::cerr << "[INFO] Resuming at " << renderer->film.totalSamples()
+                << " samples" << std::endl;
+    }
+    RenderStats stats = shards   ? shards->render()
+                        : stream ? stream->render()
+                                 : renderer->render(onPass);
+    if (o.report && renderer) renderer->scheduler.report(std::cerr);
+    if (renderer) {
+      counters.resize(renderer->counters.size());
+      for (size_t t = 0; t < counters.size(); ++t)
+        counters[t].add(renderer->counters[t]);
+    }
+    // a failed cost map is reported, the image is still written
+    bool costsWritten = true;
+    auto writeCosts = [&](const auto &cost, const std::string &path) {
+      if (path.empty()) return;
+      std::string file = withSuffix(path, suffix);
+      if (!writeCostMap(cost, renderer->film.width, renderer->film.height,
+                        file.c_str())) {
+        std::cerr << "[ERROR] Failed to write " << file << std::endl;
+        costsWritten = false;
+      }
+    };
+    writeCosts(renderer->costs.seconds, o.cost);
+    writeCosts(renderer->costs.rays, o.costRays);
+    // like the periodic saves, a failed final save is reported but the
+    // image is still written
+    bool saved = o.checkpoint.empty() ||
+                 saveCheckpoint(checkpoint, s, sceneKey, renderer->film);
+    total.seconds += stats.seconds;
+    total.samples += stats.samples;
+    total.rays += stats.rays;
+    bool written = done(shards   ? shards->film
+                        : stream ? stream->film
+                                 : renderer->film);
+    return costsWritten && saved && written;
+  };
+
+  // all renderers resolve 0 the same way
+  const int threads =
+      settings.threads > 0
+          ? settings.threads
+          : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  std::cerr << "[INFO] " << sceneName << " " << settings.width << "x"
+            << settings.height << ", " << settings.spp << " spp, " << threads
+            << " threads" << (o.wavefront ? ", wavefront" : "");
+  if (o.workers > 0) std::cerr << " x " << o.workers << " workers";
+  std::cerr << std::endl;
+  std::string output = withSuffix(o.output, suffix);
+  RenderStats stats;
+  if (o.band > 0) {
+    // only one band's film is ever alive; each goes to disk once done
+    auto image = ImageStream::open(output, settings.width, settings.height,
+                                   o.toneMapping);
+    if (!image) return -1;
+    RenderSettings band = settings;
+    while (image->remaining() > 0) {
+      band.bandHeight = std::min(o.band, image->remaining());
+      band.bandY0 = image->nextBand(band.bandHeight);
+      auto write = [&](const Film &film) {
+        return image->write(film, band.bandY0);
+      };
+      if (!renderFilm(band, write, stats)) return -1;
+    }
+    if (!image->close()) return -1;
+  } else {
+    ImageStream::Format format;
+    bool streamed = ImageStream::formatOf(output, format);
+    auto write = [&](const Film &film) {
+      bool ok = streamed
+                    ? writeStreamImage(film, output, o.toneMapping)
+                    : writeImage(film, output.c_str(), o.toneMapping);
+      if (!ok) std::cerr << "[ERROR] Failed to write " << output << std::endl;
+      if (!o.hdr.empty())
+        ok = writeStreamImage(film, withSuffix(o.hdr, suffix)) && ok;
+      if (!o.heatmap.empty())
+        writeHeatmap(film, withSuffix(o.heatmap, suffix).c_str());
+      return ok;
+    };
+    if (!renderFilm(settings, write, stats)) return -1;
+  }
+
+  if (STATS_ENABLED && !counters.empty()) printCounters(std::cerr, counters);
+  double buildSeconds = std::chrono::duration<double>(built - start).count();
+  std::cout << "{\"scene\": \"" << jsonEscape(sceneName) << "\", \"width\": "
+            << settings.width << ", \"height\": " << settings.height
+            << ", \"spp\": " << settings.spp
+            << ", \"sampler\": \"" << samplerName(settings.sampler) << "\""
+            << ", \"threads\": " << threads
+            << ", \"wavefront\": " << (o.wavefront ? "true" : "false")
+            << ", \"workers\": " << o.workers
+            << ", \"bvh\": \"" << bvhMethodName(scene.bvh) << "\""
+            << ", \"build_seconds\": " << buildSeconds
+            << ", \"total_seconds\": " << stats.seconds
+            << ", \"samples\": " << stats.samples << ", \"rays\": " << stats.rays
+            << ", \"samples_per_second\": " << stats.samples / stats.seconds
+            << ", \"rays_per_second\": " << stats.rays / stats.seconds;
+  if (STATS_ENABLED && !counters.empty()) {
+    std::cout << ", \"stats\": ";
+    writeCountersJson(std::cout, counters);
+  }
+  std::cout << "}" << std::endl;
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  RenderSettings &settings = options.settings;
+  settings.progressive = false;
+  std::vector<std::string> scenes;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char * {
+      if (i + 1 >= argc) {
+        std::cerr << "[ERROR] Missing value for " << arg << std::endl;
+        exit(-1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--width") {
+      settings.width = atoi(value());
+    } else if (arg == "--height") {
+      settings.height = atoi(value());
+    } else if (arg == "--spp") {
+      settings.spp = atoi(value());
+    } else if (arg == "--depth") {
+      settings.maxDepth = atoi(value());
+    } else if (arg == "--roulette-depth") {
+      settings.rouletteDepth = atoi(value());
+    } else if (arg == "--survival") {
+      settings.rouletteMaxSurvival = static_cast<float>(atof(value()));
+    } else if (arg == "--threads") {
+      settings.threads = atoi(value());
+    } else if (arg == "--tile") {
+      settings.tileSize = atoi(value());
+    } else if (arg == "--seed") {
+      settings.seed = strtoull(value(), nullptr, 10);
+    } else if (arg == "--sampler") {
+      const char *name = value();
+      if (!parseSamplerKind(name, settings.sampler)) {
+        std::cerr << "[ERROR] Unknown sampler " << name << std::endl;
+        return -1;
+      }
+    } else if (arg == "--scene") {
+      scenes.push_back(value());
+    } else if (arg == "--bvh") {
+      const char *method = value();
+      if (!parseBVHMethod(method, options.bvh)) {
+        std::cerr << "[ERROR] Unknown BVH method " << method << std::endl;
+        return -1;
+      }
+      options.bvhSet = true;
+    } else if (arg == "--load-cache") {
+      options.loadCache = value();
+    } else if (arg == "--save-cache") {
+      options.saveCache = value();
+    } else if (arg == "--obj") {
+      options.obj = value();
+    } else if (arg == "--output") {
+      options.output = value();
+    } else if (arg == "--hdr") {
+      options.hdr = value();
+    } else if (arg == "--tonemap") {
+      const char *op = value();
+      if (!parseToneMapOperator(op, options.toneMapping.op)) {
+        std::cerr << "[ERROR] Unknown tone mapping operator " << op
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg == "--exposure") {
+      options.toneMapping.exposure = static_cast<float>(atof(value()));
+    } else if (arg == "--gamma") {
+      options.toneMapping.gamma = static_cast<float>(atof(value()));
+    } else if (arg == "--band") {
+      options.band = atoi(value());
+    } else if (arg == "--progressive") {
+      settings.progressive = true;
+    } else if (arg == "--time-budget") {
+      settings.timeBudget = atof(value());
+      settings.progressive = true;
+    } else if (arg == "--adaptive") {
+      settings.adaptive = true;
+    } else if (arg == "--min-spp") {
+      settings.minSpp = atoi(value());
+    } else if (arg == "--threshold") {
+      settings.adaptiveThreshold = static_cast<float>(atof(value()));
+    } else if (arg == "--heatmap") {
+      options.heatmap = value();
+    } else if (arg == "--workers") {
+      options.workers = atoi(value());
+    } else if (arg == "--checkpoint") {
+      options.checkpoint = value();
+      settings.progressive = true;
+    } else if (arg == "--checkpoint-interval") {
+      options.checkpointInterval = atof(value());
+    } else if (arg == "--resume") {
+      options.resume = value();
+    } else if (arg == "--cost") {
+      options.cost = value();
+      settings.pixelCosts = true;
+    } else if (arg == "--cost-rays") {
+      options.costRays = value();
+      settings.pixelCosts = true;
+    } else if (arg == "--report") {
+      options.report = true;
+    } else if (arg == "--wavefront") {
+      options.wavefront = true;
+    } else {
+      usage(argv[0]);
+      return arg == "--help" ? 0 : -1;
+    }
+  }
+  if (settings.width <= 0 || settings.height <= 0 || settings.spp <= 0 ||
+      settings.tileSize <= 0) {
+    std::cerr << "[ERROR] Invalid image size, spp or tile size" << std::endl;
+    return -1;
+  }
+  if (options.wavefront && (settings.progressive || settings.adaptive)) {
+    std::cerr << "[ERROR] --wavefront renders a fixed spp only" << std::endl;
+    return -1;
+  }
+  bool checkpoints = !options.checkpoint.empty() || !options.resume.empty();
+  if (checkpoints && (options.wavefront || options.band > 0)) {
+    std::cerr << "[ERROR] Checkpoints need the whole film of the tile "
+                 "renderer, not --wavefront or --band"
+              << std::endl;
+    return -1;
+  }
+  ImageStream::Format hdrFormat;
+  if (!options.hdr.empty() && (!ImageStream::formatOf(options.hdr, hdrFormat) ||
+                               hdrFormat != ImageStream::Format::PFM)) {
+    std::cerr << "[ERROR] --hdr writes .pfm only" << std::endl;
+    return -1;
+  }
+  if (options.toneMapping.gamma <= 0) {
+    std::cerr << "[ERROR] Invalid gamma" << std::endl;
+    return -1;
+  }
+  // 0 or less would end every path at --roulette-depth
+  if (!(settings.rouletteMaxSurvival > 0 &&
+        settings.rouletteMaxSurvival <= 1)) {
+    std::cerr << "[ERROR] --survival must be in (0, 1]" << std::endl;
+    return -1;
+  }
+  if (options.band > 0) {
+    ImageStream::Format format;
+    if (!ImageStream::formatOf(options.output, format)) {
+      std::cerr << "[ERROR] --band writes .ppm or .pfm only" << std::endl;
+      return -1;
+    }
+    // both need the whole frame
+    if (settings.timeBudget > 0 || !options.heatmap.empty() ||
+        !options.hdr.empty()) {
+      std::cerr << "[ERROR] --band can't be combined with --time-budget, "
+                   "--heatmap or --hdr"
+                << std::endl;
+      return -1;
+    }
+  }
+  if (settings.pixelCosts &&
+      (options.wavefront || options.workers > 0 || options.band > 0)) {
+    std::cerr << "[ERROR] --cost and --cost-rays need the tile renderer's "
+                 "whole film"
+              << std::endl;
+    return -1;
+  }
+  if (options.workers > 0) {
+    if (options.wavefront || options.band > 0 || checkpoints ||
+        settings.timeBudget > 0) {
+      std::cerr << "[ERROR] --workers can't be combined with --wavefront, "
+                   "--band, checkpoints or --time-budget"
+                << std::endl;
+      return -1;
+    }
+    // share the cores unless told otherwise
+    if (settings.threads == 0)
+      settings.threads = std::max(
+          1, static_cast<int>(std::thread::hardware_concurrency()) /
+                 options.workers);
+  }
+  if (scenes.empty()) scenes.push_back("random");
+  if (!options.loadCache.empty()) scenes.assign(1, options.loadCache);
+  if (scenes.size() > 1 && !options.saveCache.empty()) {
+    std::cerr << "[ERROR] --save-cache takes a single scene" << std::endl;
+    return -1;
+  }
+  // every scene's files are named after it, so two scenes with the same
+  // name would overwrite each other's output, heat maps and checkpoints
+  std::vector<std::string> suffixes;
+  for (const auto &scene : scenes) {
+    const std::string suffix = scenes.size() > 1 ? stem(scene) : "";
+    for (size_t k = 0; k < suffixes.size(); ++k) {
+      if (suffixes[k] == suffix) {
+        std::cerr << "[ERROR] " << scenes[k] << " and " << scene
+                  << " would write to the same files" << std::endl;
+        return -1;
+      }
+    }
+    if (!options.checkpoint.empty() &&
+        !checkpointWritable(withSuffix(options.checkpoint, suffix)))
+      return -1;
+    suffixes.push_back(suffix);
+  }
+  for (size_t k = 0; k < scenes.size(); ++k) {
+    if (renderScene(scenes[k], suffixes[k], options) != 0) return -1;
+  }
+}
@@ -1,13 +1,14 @@
 #include "Window.h"
 #include "Shader.h"
 #include "Ray.h"
-#include "Sphere.h"
 #include "Camera.h"
-#include "Material.h"
+#include "SceneFile.h"
+#include "Renderer.h"
 #include <iostream>
 #include <chrono>
+#include <mutex>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "stb_image_write.h"
+#include "ImageIO.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -17,24 +18,19 @@ const int HEIGHT = 1080;
 // const int WIDTH = 1280;
 // const int HEIGHT = 720;
 
-struct Pixel {
-  float x, y;
-  Color3f c;
-} screen[WIDTH * HEIGHT];
-
-std::ostream &operator<<(std::ostream &os, const Pixel &p) {
-  os << '(' << p.x << ", " << p.y << "), " << p.c;
-  return os;
-}
+// linear radiance per pixel, row by row from the bottom left; main.vs
+// derives each point's position from its index and main.fs tone maps, so
+// exposure can change without re-rendering. The render thread fills the
+// back buffer and flips under screenMutex; the GL thread holds the lock
+// while uploading, so it never sees a torn frame
+Color3f screens[2][WIDTH * HEIGHT];
+static_assert(sizeof(Color3f) == 3 * sizeof(float),
+              "screens are uploaded as 3 floats per pixel");
+int front = 0;
+std::mutex screenMutex;
 
 inline void setPixel(int x, int y, Color3f c) {
-  auto &p = screen[y * WIDTH + x];
-  p.x = (x - WIDTH * 0.5f) / WIDTH * 2.0f;
-  p.y = (y - HEIGHT * 0.5f) / HEIGHT * 2.0f;
-  p.c = c;
-  p.c.r = clamp(p.c.r, 0, 1);
-  p.c.g = clamp(p.c.g, 0, 1);
-  p.c.b = clamp(p.c.b, 0, 1);
+  screens[1 - front][y * WIDTH + x] = c;
 }
 
 inline void doRender();
@@ -44,6 +40,8 @@ class Main : public BaseWindow {
 
   GLuint vao, vbo;
   ShaderProgram pg;
+  ToneMapSettings toneMapping;
+  bool keyDown[3] = {};
 
   void init() override {
     BaseWindow::init();
@@ -52,20 +50,60 @@ class Main : public BaseWindow {
     glGenBuffers(1, &vbo);
     glBindVertexArray(vao);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(screen), screen, GL_STREAM_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Pixel),
+    uploadScreen();
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Color3f),
                           reinterpret_cast<void *>(0));
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Pixel),
-                          reinterpret_cast<void *>(offsetof(Pixel, c)));
     glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
     pg.use();
+    pg.setInt("width", WIDTH);
+    pg.setInt("height", HEIGHT);
+    setToneMapping();
+  }
+
+  void setToneMapping() {
+    pg.setInt("op", static_cast<int>(toneMapping.op));
+    pg.setFloat("exposure", toneMapping.exposure);
+    pg.setFloat("gamma", toneMapping.gamma);
+  }
+
+  // true once per press
+  bool pressed(int key, int slot) {
+    bool down = getKey(key) == GLFW_PRESS;
+    bool first = down && !keyDown[slot];
+    keyDown[slot] = down;
+    return first;
   }
 
   void update() override {
     BaseWindow::update();
     if (getKey(GLFW_KEY_ESCAPE) == GLFW_PRESS) setWindowShouldClose(GL_TRUE);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(screen), screen, GL_STREAM_DRAW);
+    // up / down change the exposure by half a stop, T cycles the operator
+    bool changed = false;
+    if (pressed(GLFW_KEY_UP, 0)) {
+      toneMapping.exposure += 0.5f;
+      changed = true;
+    }
+    if (pressed(GLFW_KEY_DOWN, 1)) {
+      toneMapping.exposure -= 0.5f;
+      changed = true;
+    }
+    if (pressed(GLFW_KEY_T, 2)) {
+      toneMapping.op = static_cast<ToneMapOperator>(
+          (static_cast<int>(toneMapping.op) + 1) % 3);
+      changed = true;
+    }
+    if (changed) {
+      setToneMapping();
+      std::cerr << toneMapName(toneMapping.op) << ", exposure "
+                << toneMapping.exposure << std::endl;
+    }
+    uploadScreen();
+  }
+
+  void uploadScreen() {
+    std::lock_guard<std::mutex> lock(screenMutex);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(screens[front]), screens[front],
+                 GL_STREAM_DRAW);
   }
 
   void render() override {
@@ -75,130 +113,52 @@ class Main : public BaseWindow {
   }
 };
 
-void writeImage() {
-  std::vector<unsigned char> data(WIDTH * HEIGHT * 4);
-  for (int i = 0; i < WIDTH * HEIGHT; ++i) {
-    data[i * 4 + 0] = static_cast<int>(screen[i].c.r * 255.99);
-    data[i * 4 + 1] = static_cast<int>(screen[i].c.g * 255.99);
-    data[i * 4 + 2] = static_cast<int>(screen[i].c.b * 255.99);
-    data[i * 4 + 3] = 255;
-  }
-  stbi_flip_vertically_on_write(true);
-  stbi_write_png("output.png", WIDTH, HEIGHT, 4, data.data(), 0);
+// running mean of film into the back buffer, then flip
+void publish(const Film &film) {
+  for (int j = 0; j < HEIGHT; ++j)
+    for (int i = 0; i < WIDTH; ++i) setPixel(i, j, film.mean(i, j));
+  std::lock_guard<std::mutex> lock(screenMutex);
+  front = 1 - front;
 }
 
 #include <thread>
 
-void render();
+void render(const std::string &sceneName);
 
-int main() {
+// usage: main [scene], a built-in scene name or a scene file (random)
+int main(int argc, char **argv) {
+  std::string scene = argc > 1 ? argv[1] : "random";
   WindowConfig config;
   config.width = WIDTH;
   config.height = HEIGHT;
   // config.swapInterval = 10;
-  std::thread th(render);
+  std::thread th(render, scene);
   Main main(config);
   runProgram(main);
   th.join();
 }
 
-const int MAX_DEPTH = 50;
-
-Color3f rayColor(const Ray &r, const Hitable &objs, int dep) {
-  if (dep <= 0) return Color3f(0, 0, 0);
-  HitRecord rec;
-  if (objs.hit(r, 0.001, std::numeric_limits<float>::infinity(), rec)) {
-    Ray scattered;
-    Color3f attenuation;
-    if (rec.material->scatter(r, rec, attenuation, scattered))
-      return attenuation * rayColor(scattered, objs, dep - 1);
-    return Color3f(0, 0, 0);
-  }
-
-  auto uDir = normalize(r.dir);
-  float t = 0.5f * (uDir.y + 1);
-  return (1 - t) * Vec3f(1.0f, 1.0f, 1.0f) + t * Vec3f(0.5f, 0.7f, 1.0f);
-}
-
-HitList randomScene() {
-  HitList world;
-  auto groundMaterial = std::make_shared<Lambertian>(Color3f(0.5, 0.5, 0.5));
-  world.add(
-      std::make_shared<Sphere>(Point3f(0, -1000, 0), 1000.0f, groundMaterial));
-  for (int a = -11; a < 11; ++a) {
-    for (int b = -11; b < 11; ++b) {
-      float chooseMat = randomFloat();
-      Point3f center(a + 0.9 * randomFloat(), 0.2, b + 0.9 * randomFloat());
-      if ((center - Point3f(4, 0.2, 0)).norm() > 0.9) {
-        std::shared_ptr<Material> sphereMaterial;
-        if (chooseMat < 0.8) {
-          // diffuse
-          auto albedo = randomVec3f() * randomVec3f();
-          sphereMaterial = std::make_shared<Lambertian>(albedo);
-          world.add(std::make_shared<Sphere>(center, 0.2f, sphereMaterial));
-        } else if (chooseMat < 0.95) {
-          // metal
-          auto albedo = randomVec3f(0.5, 1);
-          auto fuzz = randomFloat(0, 0.5);
-          sphereMaterial = std::make_shared<Metal>(albedo, fuzz);
-          world.add(std::make_shared<Sphere>(center, 0.2f, sphereMaterial));
-        } else {
-          // glass
-          sphereMaterial = std::make_shared<Dielectric>(1.5f);
-          world.add(std::make_shared<Sphere>(center, 0.2f, sphereMaterial));
-        }
-      }
-    }
-  }
-  auto material1 = std::make_shared<Dielectric>(1.5f);
-  world.add(std::make_shared<Sphere>(Point3f(0, 1, 0), 1.0f, material1));
-
-  auto material2 = std::make_shared<Lambertian>(Color3f(0.4, 0.2, 0.1));
-  world.add(std::make_shared<Sphere>(Point3f(-4, 1, 0), 1.0f, material2));
-
-  auto material3 = std::make_shared<Metal>(Color3f(0.7, 0.6, 0.5), 0.0f);
-  world.add(std::make_shared<Sphere>(Point3f(4, 1, 0), 1.0f, material3));
-
-  return world;
-}
-
-void render() {
+void render(const std::string &sceneName) {
   std::cerr << "thread start" << std::endl;
   std::this_thread::sleep_for(std::chrono::milliseconds(500));
   std::cerr << "render start" << std::endl;
-  auto start = std::chrono::high_resolution_clock::now();
-  Point3f lookfrom(13, 2, 3), lookat(0, 0, 0), up(0, 1, 0);
-  const float aspectRatio = static_cast<float>(WIDTH) / HEIGHT;
-  float disToFocus = 10.0;
-  float aperture = 0.1;
-  Camera cam(lookfrom, lookat, up, 20, aspectRatio, aperture, disToFocus);
-
-  HitList world = randomScene();
-  const int SPP = 64;
-  std::cerr << "SPP = " << SPP << std::endl;
-#pragma omp parallel for
-  for (int i = 0; i < WIDTH; ++i) {
-    for (int j = 0; j < HEIGHT; ++j) {
-      Color3f pc(0, 0, 0);
-      for (int s = 0; s < SPP; ++s) {
-        float u = (i + randomFloat()) / WIDTH;
-        float v = (j + randomFloat()) / HEIGHT;
-        Ray r = cam.getRay(u, v);
-        pc += rayColor(r, world, MAX_DEPTH);
-      }
-      pc /= SPP;
-      pc.r = sqrt(pc.r);
-      pc.g = sqrt(pc.g);
-      pc.b = sqrt(pc.b);
-      setPixel(i, j, pc);
-    }
-  }
-  auto end = std::chrono::high_resolution_clock::now();
-  std::cerr
-      << "done, cost: "
-      << std::chrono::duration_cast<std::chrono::seconds>(end - start).count()
-      << "s" << std::endl;
+  RenderSettings settings;
+  settings.width = WIDTH;
+  settings.height = HEIGHT;
+  Scene scene;
+  if (!loadScene(sceneName, settings.seed, scene)) return;
+  Camera cam = scene.camera.makeCamera(static_cast<float>(WIDTH) / HEIGHT);
+  auto world = buildWorld(scene);
+  std::cerr << "SPP = " << settings.spp << std::endl;
+
+  Renderer renderer(settings, cam, *world, scene.materials);
+  RenderStats stats = renderer.render(publish);
+  std::cerr << "done, cost: " << stats.seconds << "s, "
+            << static_cast<double>(stats.samples) / (WIDTH * HEIGHT)
+            << " spp on average" << std::endl;
+  renderer.scheduler.report(std::cerr);
   std::cerr << "write image" << std::endl;
-  writeImage();
+  writeImage(renderer.film, "output.png");
+  if (settings.adaptive) writeHeatmap(renderer.film, "samples.png");
   std::cerr << "done" << std::endl;
 }
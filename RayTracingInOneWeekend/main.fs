@@ -3,6 +3,17 @@
 in vec3 mColor;
 out vec4 fragColor;
 
+// ToneMapSettings, see ToneMap.h
+uniform int op;
+uniform float exposure;
+uniform float gamma;
+
 void main() {
-  fragColor = vec4(mColor, 1.0);
-}
\ No newline at end of file
+  vec3 x = max(mColor * exp2(exposure), vec3(0.0));
+  if (op == 1) {
+    x = x / (1.0 + x);
+  } else if (op == 2) {
+    x = x * (2.51 * x + 0.03) / (x * (2.43 * x + 0.59) + 0.14);
+  }
+  fragColor = vec4(pow(min(x, vec3(1.0)), vec3(1.0 / gamma)), 1.0);
+}
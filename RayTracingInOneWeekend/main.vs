@@ -1,11 +1,17 @@
 #version 430 core
 
-layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec3 aColor;
+layout (location = 0) in vec3 aColor;
+
+uniform int width;
+uniform int height;
 
 out vec3 mColor;
 
 void main() {
-  gl_Position = vec4(aPos, 1.0, 1.0);
+  // one point per pixel, numbered row by row from the bottom left
+  float x = float(gl_VertexID % width);
+  float y = float(gl_VertexID / width);
+  gl_Position = vec4((x - width * 0.5) / width * 2.0,
+                     (y - height * 0.5) / height * 2.0, 1.0, 1.0);
   mColor = aColor;
-}
\ No newline at end of file
+}
@@ -0,0 +1,69 @@
+#include "ImageStream.h"
+#include "ToneMap.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "ImageIO.h"
+
+// re-exposes a linear PFM (e.g. from headless --hdr) as an 8-bit png
+// without rendering again
+
+void usage(const char *name) {
+  std::cerr << "usage: " << name << " IN.pfm OUT.png [options]\n"
+            << "  --op NAME      clamp | reinhard | aces (clamp)\n"
+            << "  --exposure F   stops, scales radiance by 2^F (0)\n"
+            << "  --gamma F      display gamma (2)\n";
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> paths;
+  ToneMapSettings toneMapping;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char * {
+      if (i + 1 >= argc) {
+        std::cerr << "[ERROR] Missing value for " << arg << std::endl;
+        exit(-1);
+      }
+      return argv[++i];
+    };
+    if (arg == "--op") {
+      const char *op = value();
+      if (!parseToneMapOperator(op, toneMapping.op)) {
+        std::cerr << "[ERROR] Unknown tone mapping operator " << op
+                  << std::endl;
+        return -1;
+      }
+    } else if (arg == "--exposure") {
+      toneMapping.exposure = static_cast<float>(atof(value()));
+    } else if (arg == "--gamma") {
+      toneMapping.gamma = static_cast<float>(atof(value()));
+    } else if (arg.size() > 1 && arg[0] == '-') {
+      usage(argv[0]);
+      return arg == "--help" ? 0 : -1;
+    } else {
+      paths.push_back(arg);
+    }
+  }
+  if (paths.size() != 2 || toneMapping.gamma <= 0) {
+    usage(argv[0]);
+    return -1;
+  }
+
+  int width, height;
+  std::vector<float> rgb;
+  if (!readPfm(paths[0], width, height, rgb)) return -1;
+  auto start = std::chrono::high_resolution_clock::now();
+  if (!writeImage(rgb.data(), width, height, paths[1].c_str(), toneMapping)) {
+    std::cerr << "[ERROR] Failed to write " << paths[1] << std::endl;
+    return -1;
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cerr << "[INFO] " << width << "x" << height << " "
+            << toneMapName(toneMapping.op) << ", "
+            << std::chrono::duration<double, std::milli>(end - start).count()
+            << " ms" << std::endl;
+}